@@ -0,0 +1,161 @@
+#pragma once
+
+#include <string_view>
+#include <string>
+#include <vector>
+#include <variant>
+#include <array>
+#include <optional>
+#include <unordered_map>
+#include <memory>
+
+#include "exhparser.h"
+#include "excelstringpool.h"
+
+struct EXDPage;
+
+using ExcelColumnValues = std::variant<std::monostate,
+                                       std::vector<int8_t>,
+                                       std::vector<uint8_t>,
+                                       std::vector<int16_t>,
+                                       std::vector<uint16_t>,
+                                       std::vector<int32_t>,
+                                       std::vector<uint32_t>,
+                                       std::vector<float>,
+                                       std::vector<int64_t>,
+                                       std::vector<uint64_t>>;
+
+/*
+ * A single column of a sheet, stored in one contiguous array.
+ *
+ * Numeric columns are a typed array in native byte order, Bool and PackedBool columns are a packed bitset and
+ * strings are stored back to back in one arena with an offset table (with one extra entry at the end). Once the
+ * strings are interned (see internStrings) the arena is replaced by ids into a shared pool.
+ */
+struct ExcelColumn {
+    // the index of this column in the EXH
+    size_t index = 0;
+    ExcelColumnDefinition definition;
+
+    ExcelColumnValues values;
+    std::vector<uint64_t> bits;
+
+    std::vector<uint32_t> stringOffsets;
+    std::string stringArena;
+
+    // only used when the strings are interned
+    std::shared_ptr<const ExcelStringPool> stringPool;
+    std::vector<ExcelStringRef> stringRefs;
+
+    template<typename T>
+    const std::vector<T>& getValues() const {
+        return std::get<std::vector<T>>(values);
+    }
+
+    bool getBool(size_t row) const {
+        return (bits[row / 64] >> (row % 64)) & 1;
+    }
+
+    std::string_view getString(size_t row) const {
+        if(stringPool != nullptr)
+            return stringPool->get(stringRefs[row]);
+
+        return std::string_view(stringArena).substr(stringOffsets[row], stringOffsets[row + 1] - stringOffsets[row]);
+    }
+
+    /*
+     * Returns any integer or bool column widened to 64-bit, floats are truncated.
+     */
+    int64_t getInteger(size_t row) const;
+
+    /*
+     * This doesn't include the string pool, since it's shared.
+     */
+    size_t memoryUsage() const;
+};
+
+/*
+ * Excel data stored column by column instead of row by row, rows are identified by their position.
+ */
+struct ColumnarSheet {
+    std::vector<uint32_t> rowIds;
+    std::vector<uint16_t> subrowIds;
+
+    std::vector<ExcelColumn> columns;
+
+    size_t size() const {
+        return rowIds.size();
+    }
+
+    size_t memoryUsage() const;
+};
+
+/*
+ * A whole sheet (every page) in one or more languages.
+ */
+struct ExcelSheet {
+    std::string name;
+    EXH exh;
+
+    // data[i] is the sheet in languages[i], sheets without languages only have Language::None
+    std::vector<Language> languages;
+    std::vector<ColumnarSheet> data;
+
+    // row id -> position of the row's first subrow, this is the same for every language
+    std::unordered_map<uint32_t, size_t> rowIndex;
+
+    const ColumnarSheet* getLanguage(Language language) const;
+
+    /*
+     * Returns the position of the row in the columnar data.
+     */
+    std::optional<size_t> findRow(uint32_t rowId, uint16_t subrow = 0) const;
+
+    void buildRowIndex();
+};
+
+/*
+ * A precompiled decoder for the columns of a sheet, this only has to be built once per sheet.
+ *
+ * Columns are grouped by their width, so every fixed-width column is decoded by one branchless load + byte swap
+ * loop over all the rows of a page instead of switching on the type of every cell.
+ */
+struct ExcelDecodePlan {
+    struct Target {
+        uint16_t offset;
+        // the position of the column in ColumnarSheet::columns
+        uint32_t column;
+        // only used by packed bools
+        uint8_t mask;
+    };
+
+    // the EXH column indices that are decoded, in the order they are stored
+    std::vector<size_t> columns;
+    std::vector<ExcelColumnDefinition> definitions;
+
+    // fixed[0] are 1-byte columns, fixed[1] 2-byte, fixed[2] 4-byte and fixed[3] 8-byte
+    std::array<std::vector<Target>, 4> fixed;
+    std::vector<Target> bools;
+    std::vector<Target> strings;
+};
+
+/*
+ * Builds a decode plan for the given columns, or every column if it is empty.
+ */
+ExcelDecodePlan compileDecodePlan(const std::vector<ExcelColumnDefinition>& definitions, const std::vector<size_t>& columns = {});
+
+/*
+ * Decodes every row of the page into columns. If columns is not empty, only those columns are decoded and stored.
+ */
+ColumnarSheet readColumnarEXD(const EXDPage& page, const std::vector<size_t>& columns = {});
+
+/*
+ * Decodes every row of the page and appends it to an existing sheet, this is used to merge multiple pages.
+ * The column selection is only used when the sheet is still empty, afterwards the sheet's own columns are used.
+ */
+void appendColumnarEXD(ColumnarSheet& sheet, const EXDPage& page, const std::vector<size_t>& columns = {});
+
+/*
+ * Same as above, but with a decode plan that was already compiled for this sheet.
+ */
+void appendColumnarEXD(ColumnarSheet& sheet, const EXDPage& page, const ExcelDecodePlan& plan);
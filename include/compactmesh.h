@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mdlparser.h"
+
+/*
+ * A vertex that keeps the precision the game stores it in, 32 bytes instead of the 52 of Vertex. UVs and normals stay
+ * half floats, bone weights stay unorm8. Positions are kept as full floats, since they are often stored that way.
+ */
+struct CompactVertex {
+    std::array<float, 3> position;
+    std::array<uint16_t, 2> uv;
+    // the fourth half is only padding
+    std::array<uint16_t, 4> normal;
+
+    std::array<uint8_t, 4> boneWeights;
+    std::array<uint8_t, 4> boneIds;
+};
+
+static_assert(sizeof(CompactVertex) == 32);
+
+// these decode a single attribute, so only what's actually used has to be converted
+std::array<float, 2> getUV(const CompactVertex& vertex);
+std::array<float, 3> getNormal(const CompactVertex& vertex);
+std::array<float, 4> getBoneWeights(const CompactVertex& vertex);
+
+Vertex decodeVertex(const CompactVertex& vertex);
+
+struct CompactPart {
+    std::vector<CompactVertex> vertices;
+    std::vector<uint16_t> indices;
+
+    std::vector<PartSubmesh> submeshes;
+
+    // see Part::startIndex
+    uint32_t startIndex = 0;
+
+    // see Part::boneTable
+    std::vector<uint16_t> boneTable;
+};
+
+struct CompactLod {
+    std::vector<CompactPart> parts;
+};
+
+struct CompactModel {
+    std::vector<CompactLod> lods;
+
+    std::vector<std::string> affectedBoneNames;
+
+    // the heap memory held by the model, plus the model itself
+    size_t memoryUsage() const;
+};
+
+/*
+ * Builds a compact model straight from the streams in the file. Elements that are already stored as halves or unorm8
+ * are copied as they are, so decoding them gives exactly the same values as parseMDL() would.
+ */
+CompactModel buildCompactModel(const ModelView& view);
+
+/*
+ * Quantizes an already parsed model, UVs and normals are rounded to the nearest half and weights to the nearest
+ * 1/255th. The model has to be parsed into Vertex structs, not PartStreams.
+ */
+CompactModel buildCompactModel(const Model& model);
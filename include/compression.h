@@ -1,7 +1,24 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 
 namespace zlib {
     void no_header_decompress(uint8_t* in, uint32_t in_size, uint8_t* out, uint32_t out_size);
-}
\ No newline at end of file
+
+    /*
+     * Compresses to a raw deflate stream (no header), which no_header_decompress can read back.
+     */
+    std::vector<uint8_t> no_header_compress(const uint8_t* in, uint32_t in_size, int level);
+}
+
+#ifdef LZ4_SUPPORTED
+namespace lz4 {
+    /*
+     * Decompresses an LZ4 block into out, which has to be exactly out_size bytes once decompressed.
+     */
+    void block_decompress(const uint8_t* in, uint32_t in_size, uint8_t* out, uint32_t out_size);
+
+    std::vector<uint8_t> block_compress(const uint8_t* in, uint32_t in_size);
+}
+#endif
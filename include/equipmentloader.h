@@ -0,0 +1,67 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lrucache.h"
+#include "mdlparser.h"
+#include "types/race.h"
+#include "types/slot.h"
+
+class GameData;
+
+struct EquipmentModelRequest {
+    int modelId;
+    Race race;
+    Slot slot;
+};
+
+struct EquipmentModel {
+    int modelId;
+    Race race;
+    Slot slot;
+
+    std::string path;
+
+    // nullptr if this combination doesn't exist in the game data
+    std::shared_ptr<const Model> model;
+};
+
+/*
+ * Loads equipment models in bulk. Which paths exist is resolved with one pass over each index file, then the models
+ * are extracted and parsed in parallel. Parsed models are kept in a bounded cache shared between calls, so identical
+ * requests are only ever parsed once.
+ */
+class EquipmentLoader {
+public:
+    explicit EquipmentLoader(GameData& data, size_t cacheCapacity = 256);
+
+    /*
+     * Returns one entry per request, in the same order.
+     */
+    std::vector<EquipmentModel> load(const std::vector<EquipmentModelRequest>& requests,
+                                     const MDLParseOptions& options = {},
+                                     size_t threadCount = 0);
+
+    /*
+     * Loads every combination of the model ids, races and slots. The result is ordered by model id, then race, then
+     * slot.
+     */
+    std::vector<EquipmentModel> load(const std::vector<int>& modelIds,
+                                     const std::vector<Race>& races,
+                                     const std::vector<Slot>& slots,
+                                     const MDLParseOptions& options = {},
+                                     size_t threadCount = 0);
+
+    size_t getCacheHits();
+    size_t getCacheMisses();
+
+    void clearCache();
+
+private:
+    GameData& data;
+
+    // keyed by the path and the parse options
+    LRUCache<std::string, std::shared_ptr<const Model>> cache;
+};
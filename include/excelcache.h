@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "exhparser.h"
+
+struct ColumnarSheet;
+
+/*
+ * A column inside of a mapped cache file, the pointers point directly into the mapping.
+ */
+struct ExcelCacheColumn {
+    // the index of this column in the EXH
+    uint32_t index = 0;
+    ExcelColumnDefinition definition;
+
+    // fixed-width values in native byte order
+    const void* values = nullptr;
+    // Bool and PackedBool columns
+    const uint64_t* bits = nullptr;
+    // String columns, rowCount + 1 offsets into the arena
+    const uint32_t* stringOffsets = nullptr;
+    const char* stringArena = nullptr;
+};
+
+/*
+ * A compiled excel sheet (one language) that is memory mapped from disk. Nothing is decoded or copied when it is
+ * opened: fixed-width columns are arrays in the file and all of the strings of a column are in one blob.
+ */
+class MappedExcelSheet {
+public:
+    size_t size() const {
+        return rowCount;
+    }
+
+    const uint32_t* getRowIds() const {
+        return rowIds;
+    }
+
+    const uint16_t* getSubrowIds() const {
+        return subrowIds;
+    }
+
+    const std::vector<ExcelCacheColumn>& getColumns() const {
+        return columns;
+    }
+
+    const std::string& getVersion() const {
+        return version;
+    }
+
+    template<typename T>
+    const T* getValues(size_t column) const {
+        return static_cast<const T*>(columns.at(column).values);
+    }
+
+    bool getBool(size_t column, size_t row) const;
+
+    std::string_view getString(size_t column, size_t row) const;
+
+    /*
+     * Returns any integer or bool column widened to 64-bit, floats are truncated.
+     */
+    int64_t getInteger(size_t column, size_t row) const;
+
+    /*
+     * Returns the position of the row, rows are sorted by id so this is a binary search.
+     */
+    std::optional<size_t> findRow(uint32_t rowId, uint16_t subrow = 0) const;
+
+private:
+    friend std::optional<MappedExcelSheet> openExcelCache(std::string_view path, std::string_view version);
+
+    std::shared_ptr<const uint8_t> mapping;
+    size_t mappingSize = 0;
+
+    std::string version;
+    size_t rowCount = 0;
+    const uint32_t* rowIds = nullptr;
+    const uint16_t* subrowIds = nullptr;
+
+    std::vector<ExcelCacheColumn> columns;
+};
+
+/*
+ * Writes a sheet to a cache file, tagged with a version (e.g. the game version). The file is replaced atomically, so
+ * readers only ever see the old or the new cache.
+ */
+void writeExcelCache(const ColumnarSheet& sheet, std::string_view path, std::string_view version);
+
+/*
+ * Maps a cache file. Returns nothing if the file doesn't exist, is corrupt or was written for a different version.
+ */
+std::optional<MappedExcelSheet> openExcelCache(std::string_view path, std::string_view version);
+
+std::string getExcelCachePath(std::string_view cacheDirectory, std::string_view sheet, Language language);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "language.h"
+
+class GameData;
+
+enum class ExcelExportFormat {
+    // one row per line, strings are always quoted
+    CSV,
+    // one JSON object per row: {"id": 1, "subrow": 0, "columns": [...]}
+    JSONLines,
+    // a header with the column definitions, then one columnar block per page (see excelexport.cpp for the layout)
+    Columnar
+};
+
+struct ExcelExportProgress {
+    std::string_view sheet;
+    Language language = Language::None;
+
+    size_t pagesDone = 0;
+    size_t pageCount = 0;
+
+    // only used by exportSheets
+    size_t sheetsDone = 0;
+    size_t sheetCount = 0;
+};
+
+/*
+ * Called after every page. When exporting in parallel, calls are serialized but can come from any thread, and
+ * exportSheets calls it once more after each sheet is finished, including sheets without any pages.
+ */
+using ExcelExportCallback = std::function<void(const ExcelExportProgress&)>;
+
+/*
+ * Streams a sheet into out. Only one page is held in memory at a time and rows are written straight from the page
+ * buffer, without building Row or Column objects.
+ */
+void exportSheet(GameData& data, std::string_view sheet, Language language, ExcelExportFormat format,
+                 std::ostream& out, const ExcelExportCallback& progress = {});
+
+/*
+ * Exports every sheet in every requested language into a directory, one file per sheet and language, with sheets
+ * spread across threadCount threads (0 uses every hardware thread). Sheets that aren't localized are only exported
+ * once, and languages a sheet doesn't have are skipped.
+ */
+void exportSheets(GameData& data, const std::vector<std::string>& sheets, const std::vector<Language>& languages,
+                  std::string_view directory, ExcelExportFormat format, const ExcelExportCallback& progress = {},
+                  size_t threadCount = 0);
+
+std::string getExcelExportPath(std::string_view directory, std::string_view sheet, Language language, ExcelExportFormat format);
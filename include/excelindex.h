@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "language.h"
+
+struct ExcelSheet;
+
+enum class ExcelIndexType : uint8_t {
+    // constant time lookups by exact value
+    Hash,
+    // lookups by exact value or by range, in log time
+    Sorted
+};
+
+/*
+ * A secondary index over one column of a loaded sheet, for reverse lookups like "which rows have this value".
+ *
+ * Integer and bool columns are keyed by their value widened to 64-bit (floats are truncated), string columns are
+ * keyed by the string.
+ */
+struct ExcelIndex {
+    ExcelIndexType type = ExcelIndexType::Hash;
+
+    std::string sheet;
+    size_t column = 0;
+    Language language = Language::None;
+    bool isString = false;
+
+    // one entry per row, sorted by key for sorted indexes. only one of keys or stringKeys is used
+    std::vector<int64_t> keys;
+    std::vector<std::string> stringKeys;
+    std::vector<uint32_t> rowIds;
+
+    // only used by hash indexes, the hash of the key -> position of the entry
+    std::unordered_multimap<uint64_t, uint32_t> buckets;
+
+    /*
+     * Returns the row ids where the column equals this value. Subrows of the same row show up as duplicates.
+     */
+    std::vector<uint32_t> find(int64_t value) const;
+    std::vector<uint32_t> find(std::string_view value) const;
+
+    /*
+     * Returns the row ids where min <= column <= max, this is only supported by sorted indexes.
+     */
+    std::vector<uint32_t> findRange(int64_t min, int64_t max) const;
+
+    /*
+     * Rebuilds the hash buckets from the entries, this is done automatically when building or reading an index.
+     */
+    void buildBuckets();
+};
+
+/*
+ * Builds an index over a column of the sheet, the column has to be loaded (see the columns in GameData::loadSheet).
+ * For string columns, the language selects which localized strings are indexed.
+ */
+ExcelIndex buildExcelIndex(const ExcelSheet& sheet, size_t column, ExcelIndexType type, Language language = Language::None);
+
+/*
+ * The path of an index file in a cache directory, so indexes can be stored alongside other cached excel data.
+ */
+std::string getExcelIndexPath(std::string_view cacheDirectory, const ExcelIndex& index);
+std::string getExcelIndexPath(std::string_view cacheDirectory, std::string_view sheet, size_t column, Language language);
+
+/*
+ * Writes the index to disk, tagged with a version (e.g. the game version) so stale indexes can be detected.
+ */
+void writeExcelIndex(const ExcelIndex& index, std::string_view path, std::string_view version);
+
+/*
+ * Reads an index from disk. Returns nothing if the file doesn't exist or was written for a different version, and
+ * throws if it's truncated or corrupt.
+ */
+std::optional<ExcelIndex> readExcelIndex(std::string_view path, std::string_view version);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "exdparser.h"
+#include "language.h"
+#include "lrucache.h"
+
+class GameData;
+
+/*
+ * Follows foreign key columns (e.g. Item -> ItemUICategory) from one sheet into another.
+ *
+ * Rows are fetched one at a time through GameData's page cache and decoded rows are kept in a shared, thread-safe
+ * row cache, so walking a graph of related rows only costs the rows that are actually visited.
+ */
+class ExcelLinkResolver {
+public:
+    explicit ExcelLinkResolver(GameData& data, size_t rowCacheCapacity = 4096);
+
+    /*
+     * Declares that a column of sheet contains row ids of targetSheet.
+     */
+    void addLink(std::string_view sheet, size_t column, std::string_view targetSheet);
+
+    /*
+     * Returns the sheet that a column links to, or an empty string if there's no link for it.
+     */
+    std::string getLinkTarget(std::string_view sheet, size_t column);
+
+    /*
+     * Returns a decoded row through the row cache, or nullptr if it doesn't exist.
+     */
+    std::shared_ptr<const Row> getRow(std::string_view sheet, uint32_t rowId, uint16_t subrow = 0,
+                                      Language language = Language::None);
+
+    /*
+     * Reads the column of a row and returns the row it points to in the linked sheet, or nullptr if the column has no
+     * link or the target row doesn't exist.
+     */
+    std::shared_ptr<const Row> follow(std::string_view sheet, uint32_t rowId, size_t column,
+                                      Language language = Language::None);
+
+    /*
+     * Same as above, but for a row of sheet you already have and an explicit target sheet.
+     */
+    std::shared_ptr<const Row> follow(std::string_view sheet, const Row& row, size_t column, std::string_view targetSheet,
+                                      Language language = Language::None);
+
+    void clear();
+
+private:
+    GameData& data;
+
+    std::unordered_map<std::string, std::string> links;
+    std::mutex linksMutex;
+
+    LRUCache<std::string, std::shared_ptr<const Row>> rowCache;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "exdparser.h"
+#include "language.h"
+
+class GameData;
+
+struct ExcelPageStoreStats {
+    size_t pageCount = 0;
+    size_t compressedSize = 0;
+    size_t uncompressedSize = 0;
+
+    uint64_t accessCount = 0;
+    // the total time spent decompressing and setting up pages in getPage()
+    uint64_t accessNanoseconds = 0;
+
+    size_t getSavedBytes() const {
+        return uncompressedSize > compressedSize ? uncompressedSize - compressedSize : 0;
+    }
+
+    double getAverageAccessMicroseconds() const {
+        return accessCount == 0 ? 0.0 : accessNanoseconds / 1000.0 / accessCount;
+    }
+};
+
+/*
+ * Keeps every page of a set of sheets resident, but compressed. A page is only inflated when it's accessed, into a
+ * scratch buffer that belongs to the calling thread, so memory usage stays at the compressed size plus one page per
+ * thread. Asking for the same page again on a thread reuses the scratch buffer without inflating it again.
+ *
+ * Pages are recompressed with LZ4 when libxiv is built with it (LIBXIV_USE_LZ4), and with fast deflate settings
+ * otherwise, instead of keeping the SqPack blocks which are split up and stored with slower settings.
+ */
+class ExcelPageStore {
+public:
+    /*
+     * compressionLevel is the deflate level, and is ignored when pages are stored with LZ4.
+     */
+    explicit ExcelPageStore(GameData& data, int compressionLevel = 1);
+
+    /*
+     * Extracts and compresses every page of the sheet in these languages, in parallel. Sheets that aren't localized
+     * are stored once as Language::None.
+     */
+    void addSheet(std::string_view sheet, const std::vector<Language>& languages);
+
+    /*
+     * Returns the page that contains this row, or nothing if the row isn't in any stored page. The page is a view
+     * over the scratch buffer of this thread, so it's only valid until the next call to getPage() on the same thread.
+     */
+    std::optional<EXDPage> getPage(std::string_view sheet, uint32_t rowId, Language language = Language::None);
+
+    ExcelPageStoreStats getStats() const;
+
+private:
+    struct StoredPage {
+        const EXH* exh = nullptr;
+        uint32_t size = 0;
+        std::vector<uint8_t> data;
+    };
+
+    GameData& data;
+    int compressionLevel;
+
+    // keyed by the path of the page
+    std::unordered_map<std::string, std::shared_ptr<const StoredPage>> pages;
+    mutable std::mutex pagesMutex;
+
+    size_t compressedSize = 0;
+    size_t uncompressedSize = 0;
+
+    std::atomic<uint64_t> accessCount = 0;
+    std::atomic<uint64_t> accessNanoseconds = 0;
+};
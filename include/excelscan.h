@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <vector>
+
+#include "language.h"
+
+struct EXDPage;
+class GameData;
+
+/*
+ * A set of row ids, where bit n is row id n.
+ */
+struct RowBitset {
+    RowBitset() = default;
+    explicit RowBitset(size_t size) : words((size + 63) / 64), size(size) {}
+
+    bool test(size_t rowId) const {
+        return rowId < size && ((words[rowId / 64] >> (rowId % 64)) & 1);
+    }
+
+    void set(size_t rowId);
+
+    size_t count() const;
+
+    std::vector<uint32_t> toRowIds() const;
+
+    RowBitset& operator&=(const RowBitset& other);
+    RowBitset& operator|=(const RowBitset& other);
+
+    std::vector<uint64_t> words;
+    size_t size = 0;
+};
+
+RowBitset operator&(RowBitset a, const RowBitset& b);
+RowBitset operator|(RowBitset a, const RowBitset& b);
+
+/*
+ * Matches rows where min <= column <= max. The bounds are signed by default, fractional bounds for Float32 columns
+ * and bounds above INT64_MAX for UInt64 columns use floatRange() and unsignedRange() instead. Any kind of bound can be
+ * used on any numeric column, and the limits of int64_t are treated as open bounds.
+ * Bool/PackedBool columns are treated as 0 or 1.
+ */
+struct ExcelPredicate {
+    enum class BoundType {
+        Signed,
+        Unsigned,
+        Float
+    };
+
+    size_t column = 0;
+    BoundType boundType = BoundType::Signed;
+
+    // only the pair that matches boundType is used
+    int64_t min = std::numeric_limits<int64_t>::min();
+    int64_t max = std::numeric_limits<int64_t>::max();
+
+    uint64_t unsignedMin = 0;
+    uint64_t unsignedMax = std::numeric_limits<uint64_t>::max();
+
+    double floatMin = -std::numeric_limits<double>::infinity();
+    double floatMax = std::numeric_limits<double>::infinity();
+
+    static ExcelPredicate equals(size_t column, int64_t value) {
+        return between(column, value, value);
+    }
+
+    static ExcelPredicate atLeast(size_t column, int64_t value) {
+        return between(column, value, std::numeric_limits<int64_t>::max());
+    }
+
+    static ExcelPredicate atMost(size_t column, int64_t value) {
+        return between(column, std::numeric_limits<int64_t>::min(), value);
+    }
+
+    static ExcelPredicate between(size_t column, int64_t min, int64_t max) {
+        ExcelPredicate predicate;
+        predicate.column = column;
+        predicate.min = min;
+        predicate.max = max;
+
+        return predicate;
+    }
+
+    static ExcelPredicate unsignedRange(size_t column, uint64_t min, uint64_t max = std::numeric_limits<uint64_t>::max()) {
+        ExcelPredicate predicate;
+        predicate.column = column;
+        predicate.boundType = BoundType::Unsigned;
+        predicate.unsignedMin = min;
+        predicate.unsignedMax = max;
+
+        return predicate;
+    }
+
+    // use infinity for an open bound
+    static ExcelPredicate floatRange(size_t column, double min, double max) {
+        ExcelPredicate predicate;
+        predicate.column = column;
+        predicate.boundType = BoundType::Float;
+        predicate.floatMin = min;
+        predicate.floatMax = max;
+
+        return predicate;
+    }
+};
+
+/*
+ * Evaluates the predicate over every row (and subrow) in the page, without decoding the rows. The values are
+ * gathered in batches, then byte swapped and compared with SIMD where available.
+ * The bitset is sized to fit the largest row id in the page.
+ */
+RowBitset scanPage(const EXDPage& page, const ExcelPredicate& predicate);
+
+/*
+ * Same as above, but over every page of the sheet. Pages are fetched through GameData's page cache.
+ */
+RowBitset scanSheet(GameData& data, std::string_view sheet, const ExcelPredicate& predicate, Language language = Language::None);
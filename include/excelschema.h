@@ -0,0 +1,192 @@
+#pragma once
+
+#include <string_view>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <stdexcept>
+#include <fmt/format.h>
+
+#include "exhparser.h"
+#include "exdparser.h"
+#include "gamedata.h"
+#include "utility.h"
+
+/*
+ * Sheets with a known layout can be declared as a schema, which gives typed accessors that read straight from the
+ * page buffer with offsets known at compile time. For example:
+ *
+ * struct ClassJobSchema {
+ *     static constexpr std::string_view name = "ClassJob";
+ *
+ *     using Name = ExcelField<String, 0x0>;
+ *     using Abbreviation = ExcelField<String, 0x4>;
+ *     using ClassJobParent = ExcelField<UInt8, 0x2E>;
+ *
+ *     using Fields = std::tuple<Name, Abbreviation, ClassJobParent>;
+ * };
+ *
+ * auto sheet = TypedSheet<ClassJobSchema>::open(gameData, Language::English);
+ * auto row = sheet->getPage(19)->getRow(19);
+ * std::string_view name = row->get<ClassJobSchema::Name>();
+ *
+ * (the offsets above are only an example)
+ *
+ * Rows keep their page alive, but string fields are views into the page buffer, so they are only valid as long as
+ * the row (or another reference to the page) is. Copy them into a std::string to keep them around longer.
+ *
+ * The schema is checked against the real EXH once when the sheet is opened, so a patch that moves a column throws
+ * instead of silently reading garbage.
+ */
+
+template<ExcelColumnDataType Type>
+struct ExcelColumnTraits {
+    using type = bool; // Bool and the PackedBool types
+};
+
+template<> struct ExcelColumnTraits<String> { using type = std::string_view; };
+template<> struct ExcelColumnTraits<Int8> { using type = int8_t; };
+template<> struct ExcelColumnTraits<UInt8> { using type = uint8_t; };
+template<> struct ExcelColumnTraits<Int16> { using type = int16_t; };
+template<> struct ExcelColumnTraits<UInt16> { using type = uint16_t; };
+template<> struct ExcelColumnTraits<Int32> { using type = int32_t; };
+template<> struct ExcelColumnTraits<UInt32> { using type = uint32_t; };
+template<> struct ExcelColumnTraits<Float32> { using type = float; };
+template<> struct ExcelColumnTraits<Int64> { using type = int64_t; };
+template<> struct ExcelColumnTraits<UInt64> { using type = uint64_t; };
+
+template<ExcelColumnDataType Type, uint16_t Offset>
+struct ExcelField {
+    static constexpr ExcelColumnDataType type = Type;
+    static constexpr uint16_t offset = Offset;
+
+    using value_type = typename ExcelColumnTraits<Type>::type;
+};
+
+template<typename Fields>
+struct ExcelSchemaFields;
+
+template<typename... Fields>
+struct ExcelSchemaFields<std::tuple<Fields...>> {
+    template<typename Field>
+    static constexpr bool contains = (std::is_same_v<Field, Fields> || ...);
+
+    static void validate(const std::vector<ExcelColumnDefinition>& columns, const std::string_view sheet) {
+        (validateField<Fields>(columns, sheet), ...);
+    }
+
+private:
+    template<typename Field>
+    static void validateField(const std::vector<ExcelColumnDefinition>& columns, const std::string_view sheet) {
+        for(const auto& column : columns) {
+            if(column.offset == Field::offset && column.type == Field::type)
+                return;
+        }
+
+        throw std::runtime_error(fmt::format("Sheet {} has no column of type {} at offset {:#x}.",
+                                             sheet, (int)Field::type, Field::offset));
+    }
+};
+
+/*
+ * Throws if any field in the schema doesn't exist in the EXH.
+ */
+template<typename Schema>
+void validateSchema(const EXH& exh) {
+    ExcelSchemaFields<typename Schema::Fields>::validate(exh.columnDefinitions, Schema::name);
+}
+
+/*
+ * A single row read through a schema, this holds a reference to its page so it stays valid on its own.
+ */
+template<typename Schema>
+class TypedRow {
+public:
+    TypedRow(std::shared_ptr<const EXDPage> page, const uint8_t* row) : page(std::move(page)), row(row) {}
+
+    template<typename Field>
+    typename Field::value_type get() const {
+        static_assert(ExcelSchemaFields<typename Schema::Fields>::template contains<Field>,
+                      "This field is not part of the schema.");
+
+        const uint8_t* cell = row + Field::offset;
+
+        if constexpr (Field::type == String) {
+            return page->decodeString(row, {String, Field::offset});
+        } else if constexpr (Field::type == Bool) {
+            return *cell != 0;
+        } else if constexpr (Field::type >= PackedBool0 && Field::type <= PackedBool7) {
+            return (*cell >> (Field::type - PackedBool0)) & 1;
+        } else {
+            return readBigEndian<typename Field::value_type>(cell);
+        }
+    }
+
+private:
+    std::shared_ptr<const EXDPage> page;
+    const uint8_t* row;
+};
+
+/*
+ * An EXD page read through a schema. The page isn't checked here, get these from TypedSheet::getPage() which only
+ * hands out pages of a sheet that was already validated.
+ */
+template<typename Schema>
+class TypedPage {
+public:
+    explicit TypedPage(std::shared_ptr<const EXDPage> page) : page(std::move(page)) {}
+
+    std::optional<TypedRow<Schema>> getRow(const uint32_t rowId, const uint16_t subrow = 0) const {
+        const uint8_t* row = page->getRowData(rowId, subrow);
+        if(row == nullptr)
+            return {};
+
+        return TypedRow<Schema>(page, row);
+    }
+
+    const EXDPage& getPage() const {
+        return *page;
+    }
+
+private:
+    std::shared_ptr<const EXDPage> page;
+};
+
+/*
+ * A sheet that has been checked against a schema. The check is only done once when the sheet is opened, fetching
+ * pages afterwards goes straight to GameData's page cache.
+ */
+template<typename Schema>
+class TypedSheet {
+public:
+    /*
+     * Throws if the schema doesn't match the sheet's EXH, and returns nothing if the sheet doesn't exist.
+     */
+    static std::optional<TypedSheet> open(GameData& data, const Language language = Language::None) {
+        const EXH* exh = data.getCachedExcelSheet(Schema::name);
+        if(exh == nullptr)
+            return {};
+
+        validateSchema<Schema>(*exh);
+
+        return TypedSheet(data, language);
+    }
+
+    /*
+     * Fetches the page containing this row, the GameData has to outlive the sheet.
+     */
+    std::optional<TypedPage<Schema>> getPage(const uint32_t rowId) const {
+        auto page = data->getPage(Schema::name, rowId, language);
+        if(page == nullptr)
+            return {};
+
+        return TypedPage<Schema>(std::move(page));
+    }
+
+private:
+    TypedSheet(GameData& data, const Language language) : data(&data), language(language) {}
+
+    GameData* data;
+    Language language;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "language.h"
+
+struct ExcelSheet;
+
+/*
+ * The indexed strings of one sheet. Each sheet is kept separately, so it can be rebuilt without touching the others.
+ */
+struct ExcelSearchSheet {
+    std::string name;
+    std::vector<size_t> columns;
+
+    // one entry per non-empty cell
+    std::vector<uint32_t> rowIds;
+    std::vector<uint16_t> subrowIds;
+    std::vector<uint16_t> entryColumns;
+
+    // the normalized text of each entry, entry i is text[textOffsets[i], textOffsets[i + 1])
+    std::vector<uint32_t> textOffsets;
+    std::string text;
+
+    // trigram -> the entries that contain it, in ascending order
+    std::unordered_map<uint32_t, std::vector<uint32_t>> postings;
+
+    std::string_view getText(size_t entry) const {
+        return {text.data() + textOffsets[entry], textOffsets[entry + 1] - textOffsets[entry]};
+    }
+};
+
+struct ExcelSearchResult {
+    std::string_view sheet;
+    uint32_t rowId = 0;
+    uint16_t subrow = 0;
+    size_t column = 0;
+};
+
+/*
+ * A trigram index for case-insensitive substring searches over string columns of loaded sheets, in one language.
+ *
+ * Strings are indexed as plain text (SeString payloads are stripped) and ASCII letters are lowercased, anything else
+ * is matched byte for byte. Queries look up the trigrams of the search string and then check the candidates, so
+ * results are always exact.
+ */
+struct ExcelSearchIndex {
+    Language language = Language::English;
+    std::vector<ExcelSearchSheet> sheets;
+
+    /*
+     * Indexes these string columns of the sheet, they have to be loaded in the language of the index (or the sheet
+     * isn't localized). If the sheet was already indexed, it's replaced.
+     */
+    void setSheet(const ExcelSheet& sheet, const std::vector<size_t>& columns);
+
+    void removeSheet(std::string_view name);
+
+    const ExcelSearchSheet* getSheet(std::string_view name) const;
+
+    /*
+     * Returns the cells that contain the query, ordered by sheet and then row. A limit of 0 returns every match.
+     */
+    std::vector<ExcelSearchResult> search(std::string_view query, size_t limit = 0) const;
+};
+
+/*
+ * Writes the index to disk, tagged with a version (e.g. the game version) so stale indexes can be detected.
+ */
+void writeExcelSearchIndex(const ExcelSearchIndex& index, std::string_view path, std::string_view version);
+
+/*
+ * Reads an index from disk. Returns nothing if the file doesn't exist, is corrupt or was written for a different
+ * version.
+ */
+std::optional<ExcelSearchIndex> readExcelSearchIndex(std::string_view path, std::string_view version);
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ExcelSheet;
+
+using ExcelStringRef = uint32_t;
+
+/*
+ * Stores every unique string once, in fixed size chunks that are never moved or freed until the pool is destroyed.
+ * Strings are deduplicated by their contents, and are referred to by a 32-bit id. The empty string is always id 0.
+ *
+ * intern() can be called from several threads at once, and views returned by get() stay valid for the lifetime of
+ * the pool. get() doesn't lock, so it's only safe for ids that the calling thread got from intern() or that were
+ * handed to it after they were interned, like the ids in a fully loaded column.
+ */
+class ExcelStringPool {
+public:
+    ExcelStringPool();
+
+    /*
+     * Returns the id of the string, it's only added if the pool doesn't have it yet.
+     */
+    ExcelStringRef intern(std::string_view string);
+
+    std::string_view get(const ExcelStringRef ref) const {
+        // ids are positions in the chunks, and each string is stored behind its length
+        const char* data = pages[ref >> pageShift]->chunks[(ref >> chunkShift) & chunkMask].get() + (ref & offsetMask);
+
+        uint32_t length;
+        memcpy(&length, data, sizeof(uint32_t));
+
+        return {data + sizeof(uint32_t), length};
+    }
+
+    /*
+     * The number of unique strings in the pool.
+     */
+    size_t size() const;
+
+    size_t memoryUsage() const;
+
+private:
+    static constexpr uint32_t chunkShift = 16;
+    static constexpr uint32_t pageShift = 24;
+    static constexpr uint32_t chunkSize = 1u << chunkShift;
+    static constexpr uint32_t chunkMask = (1u << (pageShift - chunkShift)) - 1;
+    static constexpr uint32_t offsetMask = chunkSize - 1;
+
+    struct ChunkPage {
+        std::array<std::unique_ptr<char[]>, chunkMask + 1> chunks;
+    };
+
+    ExcelStringRef store(std::string_view string);
+    void grow();
+
+    // only the chunks and pages that are already in use are read by get(), so adding new ones doesn't race with it
+    std::array<std::unique_ptr<ChunkPage>, 256> pages;
+
+    // where the next string is stored
+    uint64_t end = 0;
+    size_t stringCount = 0;
+    size_t allocatedSize = 0;
+
+    // an open addressing table of ids, indexed by the hash of the string. it's only 4 bytes per slot, so it doesn't
+    // eat up what the deduplication saves
+    std::vector<ExcelStringRef> table;
+
+    mutable std::mutex mutex;
+};
+
+/*
+ * Moves every string column of every loaded language into the pool, and replaces the per-column arenas with ids.
+ * A pool can be shared between sheets so strings that show up in several of them are only stored once, including
+ * sheets that are interned on different threads. If no pool is given, a new one is created. Returns the pool.
+ *
+ * This is meant to be done once a sheet is fully loaded, pages can't be appended to interned columns.
+ */
+std::shared_ptr<ExcelStringPool> internStrings(ExcelSheet& sheet, std::shared_ptr<ExcelStringPool> pool = nullptr);
@@ -3,11 +3,11 @@
 #include <string_view>
 #include <string>
 #include <vector>
+#include <memory>
 
+#include "exhparser.h"
 #include "memorybuffer.h"
-
-struct EXH;
-struct ExcelDataPagination;
+#include "sestring.h"
 
 struct Column {
     std::string data;
@@ -23,6 +23,105 @@ struct EXD {
     std::vector<Row> rows;
 };
 
-std::string getEXDFilename(EXH& exh, std::string_view name, std::string_view lang, ExcelDataPagination& page);
+/*
+ * A lazy view over a single decompressed EXD page.
+ *
+ * The row id -> offset table is built once when the page is created, rows and cells are only decoded when they
+ * are actually accessed. Strings are returned as views into the page buffer, so they are only valid as long as
+ * the page (or a copy of it) is alive.
+ */
+struct EXDPage {
+    EXDPage() = default;
+
+    /*
+     * Takes ownership of the decompressed page data.
+     */
+    EXDPage(const EXH& exh, MemoryBuffer data);
+
+    /*
+     * Creates a view over page data that is owned by someone else, it must outlive the page.
+     */
+    EXDPage(const EXH& exh, const uint8_t* data, size_t size);
+
+    bool hasRow(uint32_t rowId) const;
+
+    /*
+     * Returns the number of subrows in this row, this is always 1 for sheets without subrows.
+     */
+    uint16_t getSubrowCount(uint32_t rowId) const;
+
+    /*
+     * All of the row ids in this page, in ascending order.
+     */
+    const std::vector<uint32_t>& getRowIds() const {
+        return rowIds;
+    }
+
+    /*
+     * Returns a pointer to the start of the fixed-size data of a row, or nullptr if it doesn't exist.
+     * Column offsets from the EXH are relative to this.
+     */
+    const uint8_t* getRowData(uint32_t rowId, uint16_t subrow = 0) const;
+
+    Row readRow(uint32_t rowId, uint16_t subrow = 0) const;
+
+    /*
+     * Only decodes the given columns, in the order they are given. The other columns are never read.
+     */
+    Row readRow(uint32_t rowId, const std::vector<size_t>& columns, uint16_t subrow = 0) const;
+
+    Column readColumn(uint32_t rowId, size_t column, uint16_t subrow = 0) const;
+
+    /*
+     * Reads a string column without copying it, the view points into the page buffer.
+     */
+    std::string_view readString(uint32_t rowId, size_t column, uint16_t subrow = 0) const;
+
+    /*
+     * Reads a string column from a row pointer returned by getRowData().
+     */
+    std::string_view decodeString(const uint8_t* row, const ExcelColumnDefinition& column) const;
+
+    /*
+     * Same as readString, but as an SeString so the payloads can be iterated or stripped.
+     */
+    SeStringView getSeString(uint32_t rowId, size_t column, uint16_t subrow = 0) const;
+
+    const std::vector<ExcelColumnDefinition>& getColumns() const {
+        return columns;
+    }
+
+    const uint8_t* getData() const {
+        return data;
+    }
+
+    size_t getSize() const {
+        return size;
+    }
+
+private:
+    void buildRowTable();
+
+    Column decodeColumn(const uint8_t* row, const ExcelColumnDefinition& column) const;
+
+    std::shared_ptr<const MemoryBuffer> buffer;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    std::vector<ExcelColumnDefinition> columns;
+    uint16_t dataOffset = 0;
+    bool hasSubrows = false;
+
+    // indexed by rowId - firstRowId, 0 means the row isn't in this page
+    uint32_t firstRowId = 0;
+    std::vector<uint32_t> rowOffsets;
+    std::vector<uint32_t> rowIds;
+};
+
+std::string getEXDFilename(const EXH& exh, std::string_view name, std::string_view lang, const ExcelDataPagination& page);
 
-EXD readEXD(EXH& exh, MemorySpan data, ExcelDataPagination& page);
\ No newline at end of file
+/*
+ * Reads every row in the page. If columns is not empty, only those columns are decoded (in the order they are given)
+ * and the other columns are skipped entirely.
+ */
+EXD readEXD(EXH& exh, MemorySpan data, ExcelDataPagination& page, const std::vector<size_t>& columns = {});
@@ -2,6 +2,7 @@
 
 #include <string_view>
 #include <vector>
+#include <optional>
 
 #include "language.h"
 #include "memorybuffer.h"
@@ -64,4 +65,15 @@ struct EXH {
     std::vector<Language> language;
 };
 
-EXH readEXH(MemorySpan data);
\ No newline at end of file
+EXH readEXH(MemorySpan data);
+
+/*
+ * Finds the index of the column with this offset and type, which is useful for selecting columns by their layout
+ * instead of their position.
+ */
+std::optional<size_t> findColumn(const EXH& exh, uint16_t offset, ExcelColumnDataType type);
+
+/*
+ * Whether the sheet has pages for specific languages, otherwise there's only one set of pages (Language::None).
+ */
+bool isLocalized(const EXH& exh);
@@ -3,8 +3,16 @@
 #include <string_view>
 #include <string>
 #include <optional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "exhparser.h"
+#include "exdparser.h"
+#include "columnarsheet.h"
+#include "excelcache.h"
+#include "lrucache.h"
 #include "exlparser.h"
+#include "mdlparser.h"
 #include "indexparser.h"
 #include "sqpack.h"
 #include "memorybuffer.h"
@@ -27,18 +35,74 @@ public:
 
     /*
      * This extracts the raw file from dataFilePath to outPath;
+     * For models, only the vertex and index data of the LODs in lodMask is read (bit i selects LOD i).
      */
     [[nodiscard]]
-    std::optional<MemoryBuffer> extractFile(std::string_view data_file_path);
+    std::optional<MemoryBuffer> extractFile(std::string_view data_file_path, uint8_t lodMask = allModelLods);
+
+    /*
+     * Extracts and parses a model, only the LODs and vertex usages selected in the options are read and decoded.
+     */
+    std::optional<Model> extractModel(std::string_view data_file_path, const MDLParseOptions& options = {});
 
     bool exists(std::string_view data_file_path);
 
+    /*
+     * Checks a batch of paths at once, each index file is only read one time no matter how many paths are in it.
+     * The result has one entry per path, in the same order.
+     */
+    std::vector<bool> exists(const std::vector<std::string>& data_file_paths);
+
     IndexFile<IndexHashTableEntry> getIndexListing(std::string_view folder);
 
     void extractSkeleton(Race race);
 
     std::optional<EXH> readExcelSheet(std::string_view name);
 
+    /*
+     * Loads every page of a sheet in the requested languages, the pages are extracted and decoded in parallel.
+     * Sheets that aren't localized are always loaded as Language::None. If columns is not empty, only those columns
+     * are decoded.
+     */
+    std::optional<ExcelSheet> loadSheet(std::string_view name,
+                                        const std::vector<Language>& languages,
+                                        const std::vector<size_t>& columns = {});
+
+    /*
+     * Returns the page that contains this row, it's extracted on the first access and then kept in a bounded
+     * cache of recently used pages. The language is ignored for sheets that aren't localized.
+     */
+    std::shared_ptr<const EXDPage> getPage(std::string_view sheet, uint32_t rowId, Language language = Language::None);
+
+    /*
+     * Looks up a single row by its id, only that row is decoded.
+     */
+    std::optional<Row> getRow(std::string_view sheet, uint32_t rowId, Language language = Language::None);
+
+    std::optional<Row> getSubrow(std::string_view sheet, uint32_t rowId, uint16_t subrow, Language language = Language::None);
+
+    /*
+     * Sets how many decompressed excel pages are kept around for getPage() and getRow(), the default is 64.
+     */
+    void setPageCacheCapacity(size_t pages);
+
+    /*
+     * Opens a sheet from a compiled cache in cacheDirectory, which is memory mapped and not decoded at all.
+     * If there's no valid cache for the current game version yet, the sheet is loaded and the cache is written first.
+     * The language is ignored for sheets that aren't localized, and has to be given for those that are.
+     */
+    std::optional<MappedExcelSheet> openCachedSheet(std::string_view cacheDirectory, std::string_view name, Language language);
+
+    /*
+     * Returns the game version from ffxivgame.ver, or an empty string if it can't be found.
+     */
+    std::string getGameVersion();
+
+    /*
+     * Same as readExcelSheet, but the header is only parsed once. Returns nullptr if the sheet doesn't exist.
+     */
+    const EXH* getCachedExcelSheet(std::string_view name);
+
     std::vector<std::string> getAllSheetNames();
 
     /*
@@ -58,6 +122,11 @@ private:
     std::vector<Repository> repositories;
 
     EXL rootEXL;
+
+    std::unordered_map<std::string, EXH> excelSheetCache;
+    std::mutex excelSheetCacheMutex;
+
+    LRUCache<std::string, std::shared_ptr<const EXDPage>> pageCache{64};
 };
 
 std::vector<std::uint8_t> read_data_block(FILE* file, size_t starting_position);
\ No newline at end of file
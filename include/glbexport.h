@@ -0,0 +1,33 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "havokxmlparser.h"
+#include "mdlparser.h"
+
+/*
+ * Writes one LOD of a model as binary glTF. Vertex and index data is written straight from the parts into the binary
+ * chunk, Vertex structs are described with strided accessors instead of being split up first.
+ *
+ * If a skeleton is given, its bones become nodes and every part gets a skin built from its bone table and the
+ * affectedBoneNames of the model. Bones that aren't in the skeleton are added as extra nodes at the origin.
+ */
+void writeGLB(const Model& model, std::ostream& stream, const Skeleton* skeleton = nullptr, int lod = 0);
+
+void writeGLB(const Model& model, std::string_view path, const Skeleton* skeleton = nullptr, int lod = 0);
+
+struct GLBExportJob {
+    const Model* model = nullptr;
+    const Skeleton* skeleton = nullptr;
+    int lod = 0;
+
+    std::string path;
+};
+
+/*
+ * Writes every job to its path in parallel. Models and skeletons are only read, so jobs can share them.
+ */
+void exportGLBs(const std::vector<GLBExportJob>& jobs, size_t threadCount = 0);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <array>
 #include <glm/glm.hpp>
@@ -10,13 +11,20 @@ struct Bone {
 
     Bone* parent = nullptr;
 
+    // the index of the parent in Skeleton::bones, or -1 for root bones. Unlike parent this stays valid when the
+    // skeleton is copied.
+    int parentIndex = -1;
+
     glm::mat4 localTransform, finalTransform, inversePose;
 
-    std::array<float, 3> position;
-    std::array<float, 4> rotation;
-    std::array<float, 3> scale;
+    std::array<float, 3> position = {0.0f, 0.0f, 0.0f};
+    std::array<float, 4> rotation = {0.0f, 0.0f, 0.0f, 1.0f};
+    std::array<float, 3> scale = {1.0f, 1.0f, 1.0f};
 };
 
+/*
+ * Bones are sorted so parents always come before their children.
+ */
 struct Skeleton {
     std::vector<Bone> bones;
     Bone* root_bone = nullptr;
@@ -25,4 +33,10 @@ struct Skeleton {
 /*
  * This reads a havok xml scene file, which is generated from your preferred assetcc.exe.
  */
-Skeleton parseHavokXML(const std::string_view path);
\ No newline at end of file
+Skeleton parseHavokXML(const std::string_view path);
+
+/*
+ * Same as parseHavokXML, but for a file that's already in memory. The first hkaSkeleton in the file is read, in a
+ * single pass without building a DOM.
+ */
+Skeleton parseHavokXMLData(std::string_view xml);
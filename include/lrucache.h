@@ -0,0 +1,92 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+/*
+ * A thread-safe, bounded cache that evicts the least recently used entry when it's full.
+ */
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class LRUCache {
+public:
+    explicit LRUCache(const size_t capacity) : capacity(capacity) {}
+
+    std::optional<Value> get(const Key& key) {
+        std::lock_guard lock(mutex);
+
+        const auto it = entries.find(key);
+        if(it == entries.end()) {
+            misses++;
+            return {};
+        }
+
+        // move to the front, this is the most recently used entry now
+        order.splice(order.begin(), order, it->second);
+        hits++;
+
+        return it->second->second;
+    }
+
+    void put(const Key& key, Value value) {
+        std::lock_guard lock(mutex);
+
+        const auto it = entries.find(key);
+        if(it != entries.end()) {
+            it->second->second = std::move(value);
+            order.splice(order.begin(), order, it->second);
+            return;
+        }
+
+        order.emplace_front(key, std::move(value));
+        entries[key] = order.begin();
+
+        evict();
+    }
+
+    void setCapacity(const size_t newCapacity) {
+        std::lock_guard lock(mutex);
+
+        capacity = newCapacity;
+        evict();
+    }
+
+    void clear() {
+        std::lock_guard lock(mutex);
+
+        entries.clear();
+        order.clear();
+    }
+
+    size_t size() {
+        std::lock_guard lock(mutex);
+        return entries.size();
+    }
+
+    size_t getHits() {
+        std::lock_guard lock(mutex);
+        return hits;
+    }
+
+    size_t getMisses() {
+        std::lock_guard lock(mutex);
+        return misses;
+    }
+
+private:
+    void evict() {
+        while(entries.size() > capacity) {
+            entries.erase(order.back().first);
+            order.pop_back();
+        }
+    }
+
+    size_t capacity;
+    size_t hits = 0, misses = 0;
+
+    std::list<std::pair<Key, Value>> order;
+    std::unordered_map<Key, typename std::list<std::pair<Key, Value>>::iterator, Hash> entries;
+
+    std::mutex mutex;
+};
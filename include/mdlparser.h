@@ -1,11 +1,40 @@
 #pragma once
 
 #include <string_view>
+#include <string>
 #include <vector>
 #include <array>
 
 #include "memorybuffer.h"
 
+enum class VertexType : uint8_t {
+    Single3 = 2,
+    Single4 = 3,
+    UInt = 5,
+    ByteFloat4 = 8,
+    Half2 = 13,
+    Half4 = 14
+};
+
+enum class VertexUsage : uint8_t {
+    Position = 0,
+    BlendWeights = 1,
+    BlendIndices = 2,
+    Normal = 3,
+    UV = 4,
+    Tangent2 = 5,
+    Tangent1 = 6,
+    Color = 7,
+};
+
+struct VertexElement {
+    uint8_t stream, offset;
+    VertexType type;
+    VertexUsage usage;
+    uint8_t usageIndex;
+    uint8_t padding[3];
+};
+
 struct Vertex {
     std::array<float, 3> position;
     std::array<float, 2> uv;
@@ -20,11 +49,36 @@ struct PartSubmesh {
     uint32_t boneStartIndex, boneCount;
 };
 
+/*
+ * The vertices of a part with one array per attribute, e.g. positions is x0 y0 z0 x1 y1 z1...
+ * Attributes that aren't in the model are still there, filled with zeroes.
+ */
+struct PartStreams {
+    // 3 per vertex
+    std::vector<float> positions;
+    // 2 per vertex
+    std::vector<float> uvs;
+    // 3 per vertex
+    std::vector<float> normals;
+    // 4 per vertex
+    std::vector<float> boneWeights;
+    std::vector<uint8_t> boneIds;
+};
+
 struct Part {
     std::vector<Vertex> vertices;
     std::vector<uint16_t> indices;
 
+    // only filled instead of vertices when MDLParseOptions::structureOfArrays is set
+    PartStreams streams;
+
     std::vector<PartSubmesh> submeshes;
+
+    // where the indices start in the index buffer of the whole LOD, which PartSubmesh::indexOffset points into
+    uint32_t startIndex = 0;
+
+    // part bone index -> index into Model::affectedBoneNames, the bone ids of the vertices point into this
+    std::vector<uint16_t> boneTable;
 };
 
 struct Lod {
@@ -37,4 +91,74 @@ struct Model {
     std::vector<std::string> affectedBoneNames;
 };
 
-Model parseMDL(MemorySpan data);
\ No newline at end of file
+constexpr uint8_t allModelLods = 0b111;
+constexpr uint32_t allVertexUsages = 0xFF;
+
+constexpr uint32_t getVertexUsageBit(const VertexUsage usage) {
+    return 1u << static_cast<uint8_t>(usage);
+}
+
+struct MDLParseOptions {
+    // output the vertices as PartStreams instead of Vertex structs
+    bool structureOfArrays = false;
+
+    // bit i selects LOD i, the other LODs are left empty
+    uint8_t lodMask = allModelLods;
+
+    // which vertex elements are decoded (see getVertexUsageBit), the others are left zeroed
+    uint32_t usageMask = allVertexUsages;
+};
+
+Model parseMDL(MemorySpan data, const MDLParseOptions& options = {});
+
+/*
+ * One vertex stream of a mesh, exactly as it's stored in the file.
+ */
+struct VertexStreamView {
+    const uint8_t* data = nullptr;
+    uint32_t stride = 0;
+    // stride * vertexCount
+    uint32_t size = 0;
+};
+
+struct MeshView {
+    uint32_t vertexCount = 0;
+
+    // the layout of the streams, element.stream indexes into streams
+    std::vector<VertexElement> elements;
+    std::vector<VertexStreamView> streams;
+
+    // 16-bit indices, they might not be aligned
+    const uint8_t* indices = nullptr;
+    uint32_t indexCount = 0;
+
+    uint16_t materialIndex = 0;
+
+    std::vector<PartSubmesh> submeshes;
+
+    // see Part::startIndex
+    uint32_t startIndex = 0;
+
+    // mesh bone index -> index into ModelView::boneNames, the blend indices of the vertices point into this
+    std::vector<uint16_t> boneTable;
+};
+
+struct LodView {
+    std::vector<MeshView> meshes;
+};
+
+/*
+ * The meshes of a model as views into the MDL buffer, for uploading the streams directly to the GPU. Nothing is
+ * copied or converted, so the buffer has to outlive the view.
+ */
+struct ModelView {
+    std::vector<LodView> lods;
+
+    std::vector<std::string> boneNames;
+    std::vector<std::string> materialNames;
+};
+
+/*
+ * LODs outside of lodMask are left empty, this has to match what the model was extracted with.
+ */
+ModelView parseMDLView(MemorySpan data, uint8_t lodMask = allModelLods);
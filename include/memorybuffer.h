@@ -42,6 +42,19 @@ struct MemoryBuffer {
         position = end;
     }
 
+    void write_bytes(const void* bytes, const size_t count) {
+        if(count == 0)
+            return;
+
+        size_t end = position + count;
+        if(end > data.size())
+            data.resize(end);
+
+        memcpy(data.data() + position, bytes, count);
+
+        position = end;
+    }
+
     size_t size() const {
         return data.size();
     }
@@ -75,15 +88,16 @@ struct MemorySpan {
         return std::istream(mem.get());
     }
 
+    // memcpy is used because the data isn't always aligned
     template<typename T>
     void read(T* t) {
-        *t = *reinterpret_cast<const T*>(buffer.data.data() + position);
+        memcpy(t, buffer.data.data() + position, sizeof(T));
         position += sizeof(T);
     }
 
     template<typename T>
     void read(T* t, const size_t size) {
-        *t = *reinterpret_cast<const T*>(buffer.data.data() + position);
+        memcpy(t, buffer.data.data() + position, sizeof(T));
         position += size;
     }
 
@@ -122,6 +136,10 @@ struct MemorySpan {
         return position;
     }
 
+    const uint8_t* raw_data() const {
+        return buffer.data.data();
+    }
+
 private:
     const MemoryBuffer& buffer;
 
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "mdlparser.h"
+#include "memorybuffer.h"
+
+/*
+ * A flattened BVH node, 32 bytes so two fit in a cache line. Nodes are stored depth first, so the first child of an
+ * interior node is always the node right after it.
+ */
+struct MeshBVHNode {
+    std::array<float, 3> boundsMin;
+    // the first triangle for leaves, the second child for interior nodes
+    uint32_t offset;
+    std::array<float, 3> boundsMax;
+    // 0 for interior nodes
+    uint16_t triangleCount;
+    // the axis the node was split on, which decides the order children are visited in
+    uint8_t axis;
+    uint8_t padding;
+};
+
+static_assert(sizeof(MeshBVHNode) == 32);
+
+struct MeshBVHTriangle {
+    std::array<std::array<float, 3>, 3> positions;
+
+    // where the triangle came from, the index of the part in the LOD and the first index of it in Part::indices
+    uint32_t part;
+    uint32_t index;
+};
+
+struct MeshBVH {
+    std::vector<MeshBVHNode> nodes;
+
+    // in the order the leaves reference them
+    std::vector<MeshBVHTriangle> triangles;
+};
+
+struct MeshBVHRayHit {
+    float distance;
+    // the barycentric coordinates of the hit, for the second and third vertex
+    float u, v;
+
+    uint32_t part;
+    uint32_t index;
+};
+
+struct MeshBVHClosestPoint {
+    std::array<float, 3> position;
+    float distance;
+
+    uint32_t part;
+    uint32_t index;
+};
+
+/*
+ * Builds a BVH over the triangles of every part in the LOD, choosing splits with a binned surface area heuristic. The
+ * upper levels are split first and the subtrees below them are built in parallel. Parts have to be parsed into Vertex
+ * structs, not PartStreams.
+ */
+MeshBVH buildMeshBVH(const Lod& lod, size_t threadCount = 0);
+
+/*
+ * Returns the closest triangle the ray hits within maxDistance, if any. The direction doesn't have to be normalized,
+ * but the distance is measured in multiples of it. Both sides of a triangle are hit.
+ */
+std::optional<MeshBVHRayHit> intersectRay(const MeshBVH& bvh,
+                                          const std::array<float, 3>& origin,
+                                          const std::array<float, 3>& direction,
+                                          float maxDistance = INFINITY);
+
+/*
+ * Returns the closest point on any triangle, if there's one within maxDistance.
+ */
+std::optional<MeshBVHClosestPoint> findClosestPoint(const MeshBVH& bvh,
+                                                    const std::array<float, 3>& position,
+                                                    float maxDistance = INFINITY);
+
+/*
+ * Appends the BVH to the buffer, so it can be stored next to other cached model data.
+ */
+void writeMeshBVH(const MeshBVH& bvh, MemoryBuffer& buffer);
+
+/*
+ * Reads a BVH written by writeMeshBVH() from the current position of the span. Returns nothing if it's not a BVH
+ * or was written by an incompatible version.
+ */
+std::optional<MeshBVH> readMeshBVH(MemorySpan& span);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mdlparser.h"
+
+struct MeshProcessingOptions {
+    // merges vertices that are exactly the same, bit for bit
+    bool deduplicateVertices = true;
+
+    // reorders the triangles of each submesh so vertices are reused while they're still in the post-transform cache
+    bool optimizeVertexCache = true;
+
+    // reorders the vertices into the order they're first used in, unused vertices are dropped
+    bool optimizeVertexFetch = true;
+
+    // the size of the post-transform cache that's optimized for
+    uint32_t cacheSize = 32;
+};
+
+struct MeshProcessingStats {
+    size_t vertexCountBefore = 0;
+    size_t vertexCountAfter = 0;
+
+    // see calculateACMR()
+    double acmrBefore = 0.0;
+    double acmrAfter = 0.0;
+};
+
+/*
+ * Returns the average cache miss ratio of a triangle list, which is how many vertices are transformed per triangle
+ * with a FIFO post-transform cache of cacheSize vertices. 3 is the worst case, 0.5 is about the best for large meshes.
+ */
+double calculateACMR(const std::vector<uint16_t>& indices, size_t vertexCount, uint32_t cacheSize = 32);
+
+/*
+ * Optimizes a part in place, it works on both Vertex structs and PartStreams. The number of indices doesn't change
+ * and triangles are only moved within their own submesh, so the PartSubmesh ranges stay valid.
+ */
+MeshProcessingStats processPart(Part& part, const MeshProcessingOptions& options = {});
+
+/*
+ * Runs processPart() on every part of every LOD in parallel. Returns the stats of each part, in LOD then part order.
+ */
+std::vector<MeshProcessingStats> processModel(Model& model, const MeshProcessingOptions& options = {}, size_t threadCount = 0);
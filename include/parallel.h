@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Runs function(i) for every i in [0, count) across a set of worker threads, and blocks until they are all done.
+ * If threadCount is 0 then the number of hardware threads is used. The first exception thrown is rethrown here.
+ */
+template<typename Function>
+void parallelFor(const size_t count, Function&& function, size_t threadCount = 0) {
+    if(threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    threadCount = std::min(threadCount, count);
+
+    if(threadCount <= 1) {
+        for(size_t i = 0; i < count; i++)
+            function(i);
+
+        return;
+    }
+
+    std::atomic<size_t> next = 0;
+    std::exception_ptr exception;
+    std::mutex exceptionMutex;
+
+    const auto worker = [&] {
+        while(true) {
+            const size_t i = next++;
+            if(i >= count)
+                return;
+
+            try {
+                function(i);
+            } catch(...) {
+                std::lock_guard lock(exceptionMutex);
+                if(!exception)
+                    exception = std::current_exception();
+
+                // stop handing out work
+                next = count;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for(size_t i = 0; i < threadCount - 1; i++)
+        threads.emplace_back(worker);
+
+    worker();
+
+    for(auto& thread : threads)
+        thread.join();
+
+    if(exception)
+        std::rethrow_exception(exception);
+}
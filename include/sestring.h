@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/*
+ * The macro codes of SeString payloads, these are stored in the byte after the payload start marker (0x02).
+ */
+enum class SeStringMacro : uint8_t {
+    SetResetTime = 0x06,
+    SetTime = 0x07,
+    If = 0x08,
+    Switch = 0x09,
+    PcName = 0x0A,
+    IfPcGender = 0x0B,
+    IfPcName = 0x0C,
+    Josa = 0x0D,
+    Josaro = 0x0E,
+    IfSelf = 0x0F,
+    NewLine = 0x10,
+    Wait = 0x11,
+    Icon = 0x12,
+    Color = 0x13,
+    EdgeColor = 0x14,
+    ShadowColor = 0x15,
+    SoftHyphen = 0x16,
+    Key = 0x17,
+    Scale = 0x18,
+    Bold = 0x19,
+    Italic = 0x1A,
+    Edge = 0x1B,
+    Shadow = 0x1C,
+    NonBreakingSpace = 0x1D,
+    Icon2 = 0x1E,
+    Hyphen = 0x1F,
+    Num = 0x20,
+    Hex = 0x21,
+    Kilo = 0x22,
+    Byte = 0x23,
+    Sec = 0x24,
+    Time = 0x25,
+    Float = 0x26,
+    Link = 0x27,
+    Sheet = 0x28,
+    String = 0x29,
+    Caps = 0x2A,
+    Head = 0x2B,
+    Split = 0x2C,
+    HeadAll = 0x2D,
+    Fixed = 0x2E,
+    Lower = 0x2F,
+    JaNoun = 0x30,
+    EnNoun = 0x31,
+    DeNoun = 0x32,
+    FrNoun = 0x33,
+    ChNoun = 0x34,
+    LowerHead = 0x40,
+    ColorType = 0x48,
+    EdgeColorType = 0x49,
+    Digit = 0x50,
+    Ordinal = 0x51,
+    Sound = 0x60,
+    LevelPos = 0x61
+};
+
+/*
+ * One expression inside of a payload. data covers the whole encoded expression, including its operands.
+ */
+struct SeStringExpression {
+    uint8_t type = 0;
+    std::string_view data;
+
+    // 0x01-0xCF are small integers, 0xF0-0xFE are packed integers
+    bool isInteger() const;
+    // 0xFF is a nested SeString
+    bool isString() const;
+
+    uint32_t getInteger() const;
+    std::string_view getString() const;
+};
+
+/*
+ * A payload (0x02 type length body 0x03), the body is only decoded when expressions are requested.
+ */
+struct SeStringPayload {
+    SeStringMacro type = SeStringMacro::NewLine;
+    std::string_view body;
+
+    size_t getExpressionCount() const;
+
+    /*
+     * Decodes the expressions up to this index, throws if it's out of range.
+     */
+    SeStringExpression getExpression(size_t index) const;
+};
+
+struct SeStringSegment {
+    bool isPayload = false;
+
+    // only one of these is used
+    std::string_view text;
+    SeStringPayload payload;
+};
+
+/*
+ * A non-owning view over an SeString, e.g. a string cell in a page buffer. Iterating it yields text segments and
+ * payloads in order without copying or decoding anything up front.
+ */
+class SeStringView {
+public:
+    class Iterator {
+    public:
+        Iterator(std::string_view string, size_t position);
+
+        const SeStringSegment& operator*() const {
+            return segment;
+        }
+
+        const SeStringSegment* operator->() const {
+            return &segment;
+        }
+
+        Iterator& operator++();
+
+        bool operator==(const Iterator& other) const {
+            return position == other.position;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return position != other.position;
+        }
+
+    private:
+        void decode();
+
+        std::string_view string;
+        size_t position = 0;
+        size_t next = 0;
+        SeStringSegment segment;
+    };
+
+    SeStringView() = default;
+
+    explicit SeStringView(std::string_view data) : data(data) {}
+
+    Iterator begin() const {
+        return {data, 0};
+    }
+
+    Iterator end() const {
+        return {data, data.size()};
+    }
+
+    std::string_view getData() const {
+        return data;
+    }
+
+    bool empty() const {
+        return data.empty();
+    }
+
+    /*
+     * Whether there are any payloads in the string, if not the data is already plain text.
+     */
+    bool hasPayloads() const;
+
+    /*
+     * Renders the text segments, new lines and hyphens. Every other payload is dropped.
+     */
+    std::string toPlainText() const;
+    void appendPlainText(std::string& out) const;
+
+private:
+    std::string_view data;
+};
+
+/*
+ * Returns the position of the first byte with this value, or end if there is none. This is what's used to find the
+ * null terminator of excel strings and the payload markers.
+ */
+const uint8_t* findByte(const uint8_t* begin, const uint8_t* end, uint8_t value);
+
+/*
+ * Decodes an SeString integer at data and moves it past the integer.
+ */
+uint32_t readSeStringInteger(std::string_view& data);
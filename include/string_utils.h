@@ -2,7 +2,7 @@
 
 #include <algorithm>
 
-std::vector<std::string> tokenize(const std::string_view string, const std::string_view& delimiters) {
+inline std::vector<std::string> tokenize(const std::string_view string, const std::string_view& delimiters) {
     std::vector<std::string> tokens;
 
     const size_t length = string.length();
@@ -22,11 +22,11 @@ std::vector<std::string> tokenize(const std::string_view string, const std::stri
     return tokens;
 }
 
-bool stringContains(const std::string_view a, const std::string_view b) {
+inline bool stringContains(const std::string_view a, const std::string_view b) {
     return a.find(b) != std::string::npos;
 }
 
-std::string toLowercase(std::string str) {
+inline std::string toLowercase(std::string str) {
     std::transform(str.begin(), str.end(), str.begin(),
                    [](unsigned char c){ return std::tolower(c); });
 
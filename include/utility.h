@@ -1,6 +1,8 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
+#include <cstring>
 
 template <class T>
 void endianSwap(T *objp) {
@@ -8,6 +10,33 @@ void endianSwap(T *objp) {
     std::reverse(memp, memp + sizeof(T));
 }
 
+// these are written so compilers turn them into a single bswap instruction
+inline uint8_t byteSwap(const uint8_t value) {
+    return value;
+}
+
+inline uint16_t byteSwap(const uint16_t value) {
+    return (uint16_t)((value >> 8) | (value << 8));
+}
+
+inline uint32_t byteSwap(const uint32_t value) {
+    return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+}
+
+inline uint64_t byteSwap(const uint64_t value) {
+    return ((uint64_t)byteSwap((uint32_t)value) << 32) | byteSwap((uint32_t)(value >> 32));
+}
+
+// reads a big endian value from an unaligned pointer
+template <class T>
+T readBigEndian(const uint8_t* data) {
+    T value;
+    memcpy(&value, data, sizeof(T));
+    endianSwap(&value);
+
+    return value;
+}
+
 // ported from lumina.halfextensions
 static float half_to_float(const uint16_t value) {
     unsigned int num3;
@@ -35,6 +64,47 @@ static float half_to_float(const uint16_t value) {
     return *(float *)&num3;
 }
 
+// rounds to the nearest half, ties to even
+static uint16_t float_to_half(const float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+
+    const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    const uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    // infinity and NaN
+    if(exponent == 0xFF)
+        return sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0);
+
+    const int32_t halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+    if(halfExponent >= 0x1F)
+        return sign | 0x7C00;
+
+    uint32_t shift = 13;
+    uint32_t half = 0;
+    if(halfExponent <= 0) {
+        // too small for even a denormal
+        if(halfExponent < -10)
+            return sign;
+
+        mantissa |= 0x800000;
+        shift = 14 - halfExponent;
+    } else {
+        half = halfExponent << 10;
+    }
+
+    half |= mantissa >> shift;
+
+    // a carry out of the mantissa correctly bumps the exponent
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if(remainder > halfway || (remainder == halfway && (half & 1)))
+        half++;
+
+    return sign | static_cast<uint16_t>(half);
+}
+
 static float byte_to_float(const uint8_t value) {
     return static_cast<float>(value) / 255.0f;
 }
\ No newline at end of file
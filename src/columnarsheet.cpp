@@ -0,0 +1,287 @@
+#include "columnarsheet.h"
+
+#include <stdexcept>
+
+#include "exdparser.h"
+#include "utility.h"
+
+static ExcelColumn createColumn(const size_t index, const ExcelColumnDefinition& definition) {
+    ExcelColumn column;
+    column.index = index;
+    column.definition = definition;
+
+    switch(definition.type) {
+        case String:
+            column.stringOffsets.push_back(0);
+            break;
+        case Int8:
+            column.values = std::vector<int8_t>();
+            break;
+        case UInt8:
+            column.values = std::vector<uint8_t>();
+            break;
+        case Int16:
+            column.values = std::vector<int16_t>();
+            break;
+        case UInt16:
+            column.values = std::vector<uint16_t>();
+            break;
+        case Int32:
+            column.values = std::vector<int32_t>();
+            break;
+        case UInt32:
+            column.values = std::vector<uint32_t>();
+            break;
+        case Float32:
+            column.values = std::vector<float>();
+            break;
+        case Int64:
+            column.values = std::vector<int64_t>();
+            break;
+        case UInt64:
+            column.values = std::vector<uint64_t>();
+            break;
+        default:
+            // bools and unknown types only use the bitset
+            break;
+    }
+
+    return column;
+}
+
+// U is the unsigned integer with the same width as the column, the bits are copied over as-is after swapping
+template<typename U>
+static void decodeFixedColumn(ExcelColumn& column, const std::vector<const uint8_t*>& rows, const uint16_t offset) {
+    std::visit([&rows, offset](auto& array) {
+        using T = std::decay_t<decltype(array)>;
+        if constexpr (!std::is_same_v<T, std::monostate>) {
+            using V = typename T::value_type;
+            if constexpr (sizeof(V) == sizeof(U)) {
+                const size_t start = array.size();
+                array.resize(start + rows.size());
+
+                V* out = array.data() + start;
+                for(size_t i = 0; i < rows.size(); i++) {
+                    U raw;
+                    memcpy(&raw, rows[i] + offset, sizeof(U));
+                    raw = byteSwap(raw);
+                    memcpy(out + i, &raw, sizeof(U));
+                }
+            }
+        }
+    }, column.values);
+}
+
+int64_t ExcelColumn::getInteger(const size_t row) const {
+    return std::visit([this, row](const auto& array) -> int64_t {
+        using T = std::decay_t<decltype(array)>;
+        if constexpr (std::is_same_v<T, std::monostate>) {
+            if(definition.type == String)
+                throw std::runtime_error("Column is not an integer.");
+
+            return getBool(row);
+        } else {
+            return static_cast<int64_t>(array[row]);
+        }
+    }, values);
+}
+
+size_t ExcelColumn::memoryUsage() const {
+    size_t usage = sizeof(ExcelColumn);
+
+    std::visit([&usage](const auto& array) {
+        using T = std::decay_t<decltype(array)>;
+        if constexpr (!std::is_same_v<T, std::monostate>)
+            usage += array.capacity() * sizeof(typename T::value_type);
+    }, values);
+
+    usage += bits.capacity() * sizeof(uint64_t);
+    usage += stringOffsets.capacity() * sizeof(uint32_t);
+    usage += stringArena.capacity();
+    usage += stringRefs.capacity() * sizeof(ExcelStringRef);
+
+    return usage;
+}
+
+size_t ColumnarSheet::memoryUsage() const {
+    size_t usage = sizeof(ColumnarSheet);
+    usage += rowIds.capacity() * sizeof(uint32_t);
+    usage += subrowIds.capacity() * sizeof(uint16_t);
+
+    for(const auto& column : columns)
+        usage += column.memoryUsage();
+
+    return usage;
+}
+
+const ColumnarSheet* ExcelSheet::getLanguage(const Language language) const {
+    for(size_t i = 0; i < languages.size(); i++) {
+        if(languages[i] == language)
+            return &data[i];
+    }
+
+    return nullptr;
+}
+
+std::optional<size_t> ExcelSheet::findRow(const uint32_t rowId, const uint16_t subrow) const {
+    const auto it = rowIndex.find(rowId);
+    if(it == rowIndex.end() || data.empty())
+        return {};
+
+    const size_t position = it->second + subrow;
+    const auto& sheet = data.front();
+    if(position >= sheet.size() || sheet.rowIds[position] != rowId || sheet.subrowIds[position] != subrow)
+        return {};
+
+    return position;
+}
+
+void ExcelSheet::buildRowIndex() {
+    rowIndex.clear();
+
+    if(data.empty())
+        return;
+
+    const auto& sheet = data.front();
+    rowIndex.reserve(sheet.size());
+
+    for(size_t i = 0; i < sheet.size(); i++) {
+        if(sheet.subrowIds[i] == 0)
+            rowIndex[sheet.rowIds[i]] = i;
+    }
+}
+
+ExcelDecodePlan compileDecodePlan(const std::vector<ExcelColumnDefinition>& definitions, const std::vector<size_t>& columns) {
+    ExcelDecodePlan plan;
+
+    if(columns.empty()) {
+        for(size_t i = 0; i < definitions.size(); i++)
+            plan.columns.push_back(i);
+    } else {
+        plan.columns = columns;
+    }
+
+    for(uint32_t i = 0; i < plan.columns.size(); i++) {
+        const auto& definition = definitions.at(plan.columns[i]);
+        plan.definitions.push_back(definition);
+
+        const ExcelDecodePlan::Target target = {definition.offset, i, 0};
+
+        switch(definition.type) {
+            case String:
+                plan.strings.push_back(target);
+                break;
+            case Int8:
+            case UInt8:
+                plan.fixed[0].push_back(target);
+                break;
+            case Int16:
+            case UInt16:
+                plan.fixed[1].push_back(target);
+                break;
+            case Int32:
+            case UInt32:
+            case Float32:
+                plan.fixed[2].push_back(target);
+                break;
+            case Int64:
+            case UInt64:
+                plan.fixed[3].push_back(target);
+                break;
+            case Bool:
+                plan.bools.push_back({definition.offset, i, 0xFF});
+                break;
+            case PackedBool0:
+            case PackedBool1:
+            case PackedBool2:
+            case PackedBool3:
+            case PackedBool4:
+            case PackedBool5:
+            case PackedBool6:
+            case PackedBool7:
+                plan.bools.push_back({definition.offset, i, (uint8_t)(1 << ((int) definition.type - (int) PackedBool0))});
+                break;
+            default:
+                // unknown types are always false
+                plan.bools.push_back(target);
+                break;
+        }
+    }
+
+    return plan;
+}
+
+ColumnarSheet readColumnarEXD(const EXDPage& page, const std::vector<size_t>& columns) {
+    ColumnarSheet sheet;
+    appendColumnarEXD(sheet, page, columns);
+
+    return sheet;
+}
+
+void appendColumnarEXD(ColumnarSheet& sheet, const EXDPage& page, const std::vector<size_t>& columns) {
+    if(sheet.columns.empty()) {
+        appendColumnarEXD(sheet, page, compileDecodePlan(page.getColumns(), columns));
+    } else {
+        std::vector<size_t> existingColumns;
+        for(const auto& column : sheet.columns)
+            existingColumns.push_back(column.index);
+
+        appendColumnarEXD(sheet, page, compileDecodePlan(page.getColumns(), existingColumns));
+    }
+}
+
+void appendColumnarEXD(ColumnarSheet& sheet, const EXDPage& page, const ExcelDecodePlan& plan) {
+    if(sheet.columns.empty()) {
+        for(size_t i = 0; i < plan.columns.size(); i++)
+            sheet.columns.push_back(createColumn(plan.columns[i], plan.definitions[i]));
+    }
+
+    for(const auto& target : plan.strings) {
+        if(sheet.columns[target.column].stringPool != nullptr)
+            throw std::runtime_error("Pages can't be appended to columns with interned strings.");
+    }
+
+    const size_t start = sheet.size();
+
+    std::vector<const uint8_t*> rows;
+    for(const auto rowId : page.getRowIds()) {
+        const uint16_t subrowCount = page.getSubrowCount(rowId);
+        for(uint16_t i = 0; i < subrowCount; i++) {
+            rows.push_back(page.getRowData(rowId, i));
+
+            sheet.rowIds.push_back(rowId);
+            sheet.subrowIds.push_back(i);
+        }
+    }
+
+    for(const auto& target : plan.fixed[0])
+        decodeFixedColumn<uint8_t>(sheet.columns[target.column], rows, target.offset);
+
+    for(const auto& target : plan.fixed[1])
+        decodeFixedColumn<uint16_t>(sheet.columns[target.column], rows, target.offset);
+
+    for(const auto& target : plan.fixed[2])
+        decodeFixedColumn<uint32_t>(sheet.columns[target.column], rows, target.offset);
+
+    for(const auto& target : plan.fixed[3])
+        decodeFixedColumn<uint64_t>(sheet.columns[target.column], rows, target.offset);
+
+    for(const auto& target : plan.bools) {
+        auto& bits = sheet.columns[target.column].bits;
+        bits.resize((start + rows.size() + 63) / 64);
+
+        for(size_t i = 0; i < rows.size(); i++) {
+            const uint64_t bit = (rows[i][target.offset] & target.mask) != 0;
+            bits[(start + i) / 64] |= bit << ((start + i) % 64);
+        }
+    }
+
+    for(const auto& target : plan.strings) {
+        auto& column = sheet.columns[target.column];
+
+        for(const auto row : rows) {
+            column.stringArena.append(page.decodeString(row, column.definition));
+            column.stringOffsets.push_back(column.stringArena.size());
+        }
+    }
+}
@@ -0,0 +1,253 @@
+#include "compactmesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "utility.h"
+
+std::array<float, 2> getUV(const CompactVertex& vertex) {
+    return {half_to_float(vertex.uv[0]), half_to_float(vertex.uv[1])};
+}
+
+std::array<float, 3> getNormal(const CompactVertex& vertex) {
+    return {half_to_float(vertex.normal[0]), half_to_float(vertex.normal[1]), half_to_float(vertex.normal[2])};
+}
+
+std::array<float, 4> getBoneWeights(const CompactVertex& vertex) {
+    return {byte_to_float(vertex.boneWeights[0]), byte_to_float(vertex.boneWeights[1]),
+            byte_to_float(vertex.boneWeights[2]), byte_to_float(vertex.boneWeights[3])};
+}
+
+Vertex decodeVertex(const CompactVertex& vertex) {
+    Vertex decoded;
+    decoded.position = vertex.position;
+    decoded.uv = getUV(vertex);
+    decoded.normal = getNormal(vertex);
+    decoded.boneWeights = getBoneWeights(vertex);
+    decoded.boneIds = vertex.boneIds;
+
+    return decoded;
+}
+
+static uint8_t float_to_byte(const float value) {
+    return static_cast<uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+size_t CompactModel::memoryUsage() const {
+    size_t usage = sizeof(CompactModel);
+    usage += lods.capacity() * sizeof(CompactLod);
+
+    for(const auto& lod : lods) {
+        usage += lod.parts.capacity() * sizeof(CompactPart);
+
+        for(const auto& part : lod.parts) {
+            usage += part.vertices.capacity() * sizeof(CompactVertex);
+            usage += part.indices.capacity() * sizeof(uint16_t);
+            usage += part.submeshes.capacity() * sizeof(PartSubmesh);
+            usage += part.boneTable.capacity() * sizeof(uint16_t);
+        }
+    }
+
+    usage += affectedBoneNames.capacity() * sizeof(std::string);
+    for(const auto& name : affectedBoneNames)
+        usage += name.capacity();
+
+    return usage;
+}
+
+// reads up to count halves of an element as half bits, converting from floats if they aren't stored as halves
+static void readHalves(const uint8_t* in, const VertexType type, uint16_t* out, const size_t count) {
+    switch(type) {
+        case VertexType::Half2:
+            memcpy(out, in, sizeof(uint16_t) * std::min<size_t>(count, 2));
+            break;
+        case VertexType::Half4:
+            memcpy(out, in, sizeof(uint16_t) * std::min<size_t>(count, 4));
+            break;
+        case VertexType::Single3:
+        case VertexType::Single4: {
+            float values[4];
+            const size_t floatCount = type == VertexType::Single3 ? 3 : 4;
+            memcpy(values, in, sizeof(float) * floatCount);
+
+            for(size_t i = 0; i < std::min(count, floatCount); i++)
+                out[i] = float_to_half(values[i]);
+        } break;
+        case VertexType::ByteFloat4:
+            for(size_t i = 0; i < count; i++)
+                out[i] = float_to_half(byte_to_float(in[i]));
+            break;
+        case VertexType::UInt:
+            break;
+    }
+}
+
+static void readPosition(const uint8_t* in, const VertexType type, std::array<float, 3>& out) {
+    switch(type) {
+        case VertexType::Single3:
+        case VertexType::Single4:
+            memcpy(out.data(), in, sizeof(float) * 3);
+            break;
+        case VertexType::Half4: {
+            uint16_t halves[3];
+            memcpy(halves, in, sizeof(halves));
+
+            for(int i = 0; i < 3; i++)
+                out[i] = half_to_float(halves[i]);
+        } break;
+        default:
+            break;
+    }
+}
+
+static void readWeights(const uint8_t* in, const VertexType type, std::array<uint8_t, 4>& out) {
+    switch(type) {
+        case VertexType::ByteFloat4:
+            memcpy(out.data(), in, 4);
+            break;
+        case VertexType::Single4: {
+            float values[4];
+            memcpy(values, in, sizeof(values));
+
+            for(int i = 0; i < 4; i++)
+                out[i] = float_to_byte(values[i]);
+        } break;
+        case VertexType::Half4: {
+            uint16_t halves[4];
+            memcpy(halves, in, sizeof(halves));
+
+            for(int i = 0; i < 4; i++)
+                out[i] = float_to_byte(half_to_float(halves[i]));
+        } break;
+        default:
+            break;
+    }
+}
+
+static size_t getElementSize(const VertexType type) {
+    switch(type) {
+        case VertexType::Single3:
+            return sizeof(float) * 3;
+        case VertexType::Single4:
+            return sizeof(float) * 4;
+        case VertexType::Half4:
+            return sizeof(uint16_t) * 4;
+        default:
+            return 4;
+    }
+}
+
+static CompactPart buildCompactPart(const MeshView& mesh) {
+    CompactPart part;
+    part.submeshes = mesh.submeshes;
+    part.startIndex = mesh.startIndex;
+    part.boneTable = mesh.boneTable;
+
+    part.vertices.resize(mesh.vertexCount);
+    memset(part.vertices.data(), 0, part.vertices.size() * sizeof(CompactVertex));
+
+    // same as parseMDL(), if an attribute shows up more than once the last element wins
+    for(const auto& element : mesh.elements) {
+        if(mesh.vertexCount == 0)
+            break;
+
+        if(element.stream >= mesh.streams.size())
+            throw std::runtime_error("Vertex element points to a stream that doesn't exist.");
+
+        const auto& stream = mesh.streams[element.stream];
+
+        if(element.offset + getElementSize(element.type) > stream.stride)
+            throw std::runtime_error("Vertex element is out of bounds.");
+
+        for(uint32_t i = 0; i < mesh.vertexCount; i++) {
+            const uint8_t* in = stream.data + i * stream.stride + element.offset;
+            auto& vertex = part.vertices[i];
+
+            switch(element.usage) {
+                case VertexUsage::Position:
+                    readPosition(in, element.type, vertex.position);
+                    break;
+                case VertexUsage::UV:
+                    readHalves(in, element.type, vertex.uv.data(), 2);
+                    break;
+                case VertexUsage::Normal:
+                    readHalves(in, element.type, vertex.normal.data(), 3);
+                    break;
+                case VertexUsage::BlendWeights:
+                    readWeights(in, element.type, vertex.boneWeights);
+                    break;
+                case VertexUsage::BlendIndices:
+                    if(element.type == VertexType::UInt)
+                        memcpy(vertex.boneIds.data(), in, 4);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    part.indices.resize(mesh.indexCount);
+    if(mesh.indexCount > 0)
+        memcpy(part.indices.data(), mesh.indices, mesh.indexCount * sizeof(uint16_t));
+
+    return part;
+}
+
+CompactModel buildCompactModel(const ModelView& view) {
+    CompactModel model;
+    model.affectedBoneNames = view.boneNames;
+
+    for(const auto& lodView : view.lods) {
+        CompactLod lod;
+        for(const auto& mesh : lodView.meshes)
+            lod.parts.push_back(buildCompactPart(mesh));
+
+        model.lods.push_back(std::move(lod));
+    }
+
+    return model;
+}
+
+CompactModel buildCompactModel(const Model& model) {
+    CompactModel compactModel;
+    compactModel.affectedBoneNames = model.affectedBoneNames;
+
+    for(const auto& lod : model.lods) {
+        CompactLod compactLod;
+
+        for(const auto& part : lod.parts) {
+            if(part.vertices.empty() && !part.streams.positions.empty())
+                throw std::runtime_error("Models parsed into PartStreams can't be compacted.");
+
+            CompactPart compactPart;
+            compactPart.indices = part.indices;
+            compactPart.submeshes = part.submeshes;
+            compactPart.startIndex = part.startIndex;
+            compactPart.boneTable = part.boneTable;
+
+            compactPart.vertices.resize(part.vertices.size());
+            for(size_t i = 0; i < part.vertices.size(); i++) {
+                const auto& vertex = part.vertices[i];
+                auto& compactVertex = compactPart.vertices[i];
+
+                compactVertex.position = vertex.position;
+                compactVertex.uv = {float_to_half(vertex.uv[0]), float_to_half(vertex.uv[1])};
+                compactVertex.normal = {float_to_half(vertex.normal[0]), float_to_half(vertex.normal[1]),
+                                        float_to_half(vertex.normal[2]), 0};
+
+                for(int j = 0; j < 4; j++)
+                    compactVertex.boneWeights[j] = float_to_byte(vertex.boneWeights[j]);
+
+                compactVertex.boneIds = vertex.boneIds;
+            }
+
+            compactLod.parts.push_back(std::move(compactPart));
+        }
+
+        compactModel.lods.push_back(std::move(compactLod));
+    }
+
+    return compactModel;
+}
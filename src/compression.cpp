@@ -4,6 +4,10 @@
 #include <stdexcept>
 #include <string>
 
+#ifdef LZ4_SUPPORTED
+#include <lz4.h>
+#endif
+
 // adopted from
 // https://github.com/ahom/ffxiv_reverse/blob/312a0af8b58929fab48438aceae8da587be9407f/xiv/utils/src/zlib.cpp#L31
 void zlib::no_header_decompress(uint8_t* in, uint32_t in_size, uint8_t* out, uint32_t out_size) {
@@ -29,4 +33,56 @@ void zlib::no_header_decompress(uint8_t* in, uint32_t in_size, uint8_t* out, uin
 
     // Clean up
     inflateEnd(&strm);
-}
\ No newline at end of file
+}
+
+std::vector<uint8_t> zlib::no_header_compress(const uint8_t* in, uint32_t in_size, int level) {
+    z_stream strm = {};
+
+    // -15 to leave out the header, same as above
+    auto ret = deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK) {
+        throw std::runtime_error("Error at zlib init: " + std::to_string(ret));
+    }
+
+    std::vector<uint8_t> out(deflateBound(&strm, in_size));
+
+    strm.next_in = const_cast<uint8_t*>(in);
+    strm.avail_in = in_size;
+    strm.next_out = out.data();
+    strm.avail_out = out.size();
+
+    ret = deflate(&strm, Z_FINISH);
+    deflateEnd(&strm);
+
+    if (ret != Z_STREAM_END) {
+        throw std::runtime_error("Error at zlib deflate: " + std::to_string(ret));
+    }
+
+    out.resize(strm.total_out);
+
+    return out;
+}
+
+#ifdef LZ4_SUPPORTED
+void lz4::block_decompress(const uint8_t* in, uint32_t in_size, uint8_t* out, uint32_t out_size) {
+    const int ret = LZ4_decompress_safe(reinterpret_cast<const char*>(in), reinterpret_cast<char*>(out),
+                                        static_cast<int>(in_size), static_cast<int>(out_size));
+    if (ret != static_cast<int>(out_size)) {
+        throw std::runtime_error("Error at lz4 decompress: " + std::to_string(ret));
+    }
+}
+
+std::vector<uint8_t> lz4::block_compress(const uint8_t* in, uint32_t in_size) {
+    std::vector<uint8_t> out(LZ4_compressBound(static_cast<int>(in_size)));
+
+    const int ret = LZ4_compress_default(reinterpret_cast<const char*>(in), reinterpret_cast<char*>(out.data()),
+                                         static_cast<int>(in_size), static_cast<int>(out.size()));
+    if (ret <= 0 && in_size != 0) {
+        throw std::runtime_error("Error at lz4 compress: " + std::to_string(ret));
+    }
+
+    out.resize(ret);
+
+    return out;
+}
+#endif
@@ -0,0 +1,115 @@
+#include "equipmentloader.h"
+
+#include <stdexcept>
+#include <unordered_map>
+#include <fmt/format.h>
+
+#include "equipment.h"
+#include "gamedata.h"
+#include "parallel.h"
+
+EquipmentLoader::EquipmentLoader(GameData& data, const size_t cacheCapacity) : data(data), cache(cacheCapacity) {}
+
+static std::string getCacheKey(const std::string& path, const MDLParseOptions& options) {
+    return fmt::format("{}:{}:{}:{}", path, options.lodMask, options.usageMask, options.structureOfArrays);
+}
+
+std::vector<EquipmentModel> EquipmentLoader::load(const std::vector<EquipmentModelRequest>& requests,
+                                                  const MDLParseOptions& options,
+                                                  const size_t threadCount) {
+    std::vector<EquipmentModel> results(requests.size());
+
+    // identical requests share one entry, and so one lookup and one parse
+    std::vector<std::string> uniquePaths;
+    std::unordered_map<std::string, size_t> uniqueIndices;
+    std::vector<size_t> requestIndices(requests.size());
+
+    for(size_t i = 0; i < requests.size(); i++) {
+        const auto& request = requests[i];
+
+        auto& result = results[i];
+        result.modelId = request.modelId;
+        result.race = request.race;
+        result.slot = request.slot;
+        result.path = build_equipment_path(request.modelId, request.race, request.slot);
+
+        const auto [it, inserted] = uniqueIndices.emplace(result.path, uniquePaths.size());
+        if(inserted)
+            uniquePaths.push_back(result.path);
+
+        requestIndices[i] = it->second;
+    }
+
+    std::vector<std::shared_ptr<const Model>> models(uniquePaths.size());
+
+    std::vector<std::string> missingPaths;
+    std::vector<size_t> missingIndices;
+
+    for(size_t i = 0; i < uniquePaths.size(); i++) {
+        if(auto model = cache.get(getCacheKey(uniquePaths[i], options))) {
+            models[i] = std::move(*model);
+        } else {
+            missingPaths.push_back(uniquePaths[i]);
+            missingIndices.push_back(i);
+        }
+    }
+
+    if(!missingPaths.empty()) {
+        const std::vector<bool> found = data.exists(missingPaths);
+
+        std::vector<size_t> toLoad;
+        for(size_t i = 0; i < missingPaths.size(); i++) {
+            if(found[i])
+                toLoad.push_back(i);
+        }
+
+        parallelFor(toLoad.size(), [&](const size_t i) {
+            const size_t missing = toLoad[i];
+
+            auto model = data.extractModel(missingPaths[missing], options);
+            if(!model)
+                throw std::runtime_error("Failed to extract equipment model " + missingPaths[missing]);
+
+            models[missingIndices[missing]] = std::make_shared<const Model>(std::move(*model));
+        }, threadCount);
+
+        // only existing models are cached, so models added by a patch later on are still picked up
+        for(const size_t missing : toLoad)
+            cache.put(getCacheKey(missingPaths[missing], options), models[missingIndices[missing]]);
+    }
+
+    for(size_t i = 0; i < requests.size(); i++)
+        results[i].model = models[requestIndices[i]];
+
+    return results;
+}
+
+std::vector<EquipmentModel> EquipmentLoader::load(const std::vector<int>& modelIds,
+                                                  const std::vector<Race>& races,
+                                                  const std::vector<Slot>& slots,
+                                                  const MDLParseOptions& options,
+                                                  const size_t threadCount) {
+    std::vector<EquipmentModelRequest> requests;
+    requests.reserve(modelIds.size() * races.size() * slots.size());
+
+    for(const int modelId : modelIds) {
+        for(const Race race : races) {
+            for(const Slot slot : slots)
+                requests.push_back({modelId, race, slot});
+        }
+    }
+
+    return load(requests, options, threadCount);
+}
+
+size_t EquipmentLoader::getCacheHits() {
+    return cache.getHits();
+}
+
+size_t EquipmentLoader::getCacheMisses() {
+    return cache.getMisses();
+}
+
+void EquipmentLoader::clearCache() {
+    cache.clear();
+}
@@ -0,0 +1,338 @@
+#include "excelcache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <fmt/format.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "columnarsheet.h"
+#include "memorybuffer.h"
+
+constexpr uint32_t cacheMagic = 0x43564958; // XIVC
+constexpr uint32_t cacheFormatVersion = 1;
+
+// every section starts on an 8 byte boundary, so the arrays can be used in place
+constexpr size_t cacheAlignment = 8;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t formatVersion;
+    uint32_t rowCount;
+    uint32_t columnCount;
+    uint64_t rowIdsOffset;
+    uint64_t subrowIdsOffset;
+    uint32_t versionLength;
+    uint32_t padding;
+};
+
+// offsets are 0 when a section isn't used by the column type
+struct CacheColumnEntry {
+    uint32_t index;
+    uint16_t type;
+    uint16_t offset;
+    uint64_t valuesOffset;
+    uint64_t bitsOffset;
+    uint64_t stringOffsetsOffset;
+    uint64_t stringArenaOffset;
+};
+
+static size_t alignCacheOffset(const size_t offset) {
+    return (offset + cacheAlignment - 1) & ~(cacheAlignment - 1);
+}
+
+static uint64_t writeSection(MemoryBuffer& buffer, const void* data, const size_t size) {
+    const size_t offset = alignCacheOffset(buffer.size());
+
+    buffer.seek(offset, Seek::Set);
+    buffer.write_bytes(data, size);
+
+    return offset;
+}
+
+static size_t getValueWidth(const ExcelColumnDataType type) {
+    switch(type) {
+        case Int8:
+        case UInt8:
+            return 1;
+        case Int16:
+        case UInt16:
+            return 2;
+        case Int32:
+        case UInt32:
+        case Float32:
+            return 4;
+        case Int64:
+        case UInt64:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+void writeExcelCache(const ColumnarSheet& sheet, const std::string_view path, const std::string_view version) {
+    MemoryBuffer buffer;
+
+    CacheHeader header = {};
+    header.magic = cacheMagic;
+    header.formatVersion = cacheFormatVersion;
+    header.rowCount = sheet.size();
+    header.columnCount = sheet.columns.size();
+    header.versionLength = version.size();
+
+    buffer.write(header);
+    buffer.write_bytes(version.data(), version.size());
+
+    // the column table is filled in after all of the sections are written
+    const size_t columnTableOffset = alignCacheOffset(buffer.size());
+    std::vector<CacheColumnEntry> entries(sheet.columns.size());
+    writeSection(buffer, entries.data(), entries.size() * sizeof(CacheColumnEntry));
+
+    header.rowIdsOffset = writeSection(buffer, sheet.rowIds.data(), sheet.rowIds.size() * sizeof(uint32_t));
+    header.subrowIdsOffset = writeSection(buffer, sheet.subrowIds.data(), sheet.subrowIds.size() * sizeof(uint16_t));
+
+    for(size_t i = 0; i < sheet.columns.size(); i++) {
+        const auto& column = sheet.columns[i];
+        auto& entry = entries[i];
+
+        entry.index = column.index;
+        entry.type = column.definition.type;
+        entry.offset = column.definition.offset;
+
+        if(column.definition.type == String && column.stringPool != nullptr) {
+            // interned strings are written out per column again, so the file doesn't depend on the pool
+            std::vector<uint32_t> stringOffsets = {0};
+            std::string stringArena;
+            for(size_t row = 0; row < sheet.size(); row++) {
+                stringArena.append(column.getString(row));
+                stringOffsets.push_back(stringArena.size());
+            }
+
+            entry.stringOffsetsOffset = writeSection(buffer, stringOffsets.data(), stringOffsets.size() * sizeof(uint32_t));
+            entry.stringArenaOffset = writeSection(buffer, stringArena.data(), stringArena.size());
+        } else if(column.definition.type == String) {
+            entry.stringOffsetsOffset = writeSection(buffer, column.stringOffsets.data(), column.stringOffsets.size() * sizeof(uint32_t));
+            entry.stringArenaOffset = writeSection(buffer, column.stringArena.data(), column.stringArena.size());
+        } else if(getValueWidth(column.definition.type) != 0) {
+            std::visit([&buffer, &entry](const auto& array) {
+                using T = std::decay_t<decltype(array)>;
+                if constexpr (!std::is_same_v<T, std::monostate>)
+                    entry.valuesOffset = writeSection(buffer, array.data(), array.size() * sizeof(typename T::value_type));
+            }, column.values);
+        } else {
+            std::vector<uint64_t> bits = column.bits;
+            bits.resize((sheet.size() + 63) / 64);
+
+            entry.bitsOffset = writeSection(buffer, bits.data(), bits.size() * sizeof(uint64_t));
+        }
+    }
+
+    // make sure empty trailing sections still point inside the file
+    buffer.seek(alignCacheOffset(buffer.size()), Seek::Set);
+    buffer.write<uint64_t>(0);
+
+    buffer.seek(0, Seek::Set);
+    buffer.write(header);
+
+    buffer.seek(columnTableOffset, Seek::Set);
+    buffer.write_bytes(entries.data(), entries.size() * sizeof(CacheColumnEntry));
+
+    // written to a temporary file first and then renamed over the old one, so a crash or another process writing
+    // the same cache at once never leaves a partial file behind
+    const std::string temporaryPath = fmt::format("{}.{:08x}.tmp", path, std::random_device{}());
+
+    FILE* file = fopen(temporaryPath.c_str(), "wb");
+    if(file == nullptr)
+        throw std::runtime_error("Failed to open the excel cache for writing.");
+
+    const bool written = fwrite(buffer.data.data(), buffer.data.size(), 1, file) == 1;
+    if(fclose(file) != 0 || !written) {
+        std::filesystem::remove(temporaryPath);
+        throw std::runtime_error("Failed to write the excel cache.");
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if(error) {
+        std::filesystem::remove(temporaryPath);
+        throw std::runtime_error("Failed to replace the excel cache: " + error.message());
+    }
+}
+
+static std::shared_ptr<const uint8_t> mapFile(const std::string_view path, size_t& size) {
+    if(!std::filesystem::exists(path))
+        return nullptr;
+
+#ifndef _WIN32
+    const int file = open(std::string(path).c_str(), O_RDONLY);
+    if(file < 0)
+        return nullptr;
+
+    struct stat info = {};
+    if(fstat(file, &info) != 0 || info.st_size == 0) {
+        close(file);
+        return nullptr;
+    }
+
+    size = info.st_size;
+
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+
+    if(mapping == MAP_FAILED)
+        return nullptr;
+
+    return {static_cast<const uint8_t*>(mapping), [size](const uint8_t* mapping) {
+        munmap(const_cast<uint8_t*>(mapping), size);
+    }};
+#else
+    // no mmap here, so fall back to reading the file once. it's still never decoded or copied afterwards
+    auto buffer = std::make_shared<const MemoryBuffer>(read_file_to_buffer(path));
+    size = buffer->size();
+
+    return {buffer, buffer->data.data()};
+#endif
+}
+
+std::optional<MappedExcelSheet> openExcelCache(const std::string_view path, const std::string_view version) {
+    MappedExcelSheet sheet;
+    sheet.mapping = mapFile(path, sheet.mappingSize);
+
+    if(sheet.mapping == nullptr || sheet.mappingSize < sizeof(CacheHeader))
+        return {};
+
+    const uint8_t* base = sheet.mapping.get();
+
+    CacheHeader header;
+    memcpy(&header, base, sizeof(CacheHeader));
+
+    if(header.magic != cacheMagic || header.formatVersion != cacheFormatVersion)
+        return {};
+
+    if(sizeof(CacheHeader) + header.versionLength > sheet.mappingSize)
+        return {};
+
+    sheet.version = std::string(reinterpret_cast<const char*>(base + sizeof(CacheHeader)), header.versionLength);
+    if(sheet.version != version)
+        return {};
+
+    // a corrupt or truncated file is treated like a missing one, so the cache is rebuilt
+    const auto isValidSection = [&sheet](const uint64_t offset, const size_t size) {
+        return offset % cacheAlignment == 0 && offset <= sheet.mappingSize && size <= sheet.mappingSize - offset;
+    };
+
+    sheet.rowCount = header.rowCount;
+
+    if(!isValidSection(header.rowIdsOffset, header.rowCount * sizeof(uint32_t))
+       || !isValidSection(header.subrowIdsOffset, header.rowCount * sizeof(uint16_t)))
+        return {};
+
+    sheet.rowIds = reinterpret_cast<const uint32_t*>(base + header.rowIdsOffset);
+    sheet.subrowIds = reinterpret_cast<const uint16_t*>(base + header.subrowIdsOffset);
+
+    const size_t columnTableOffset = alignCacheOffset(sizeof(CacheHeader) + header.versionLength);
+    if(!isValidSection(columnTableOffset, header.columnCount * sizeof(CacheColumnEntry)))
+        return {};
+
+    const auto entries = reinterpret_cast<const CacheColumnEntry*>(base + columnTableOffset);
+    for(size_t i = 0; i < header.columnCount; i++) {
+        const auto& entry = entries[i];
+
+        ExcelCacheColumn column;
+        column.index = entry.index;
+        column.definition = {static_cast<ExcelColumnDataType>(entry.type), entry.offset};
+
+        if(column.definition.type == String) {
+            if(!isValidSection(entry.stringOffsetsOffset, (size_t(header.rowCount) + 1) * sizeof(uint32_t)))
+                return {};
+
+            column.stringOffsets = reinterpret_cast<const uint32_t*>(base + entry.stringOffsetsOffset);
+
+            if(!isValidSection(entry.stringArenaOffset, column.stringOffsets[header.rowCount]))
+                return {};
+
+            // getString() takes the difference of neighbouring offsets, so they can never go backwards
+            if(!std::is_sorted(column.stringOffsets, column.stringOffsets + header.rowCount + 1))
+                return {};
+
+            column.stringArena = reinterpret_cast<const char*>(base + entry.stringArenaOffset);
+        } else if(getValueWidth(column.definition.type) != 0) {
+            if(!isValidSection(entry.valuesOffset, header.rowCount * getValueWidth(column.definition.type)))
+                return {};
+
+            column.values = base + entry.valuesOffset;
+        } else {
+            if(!isValidSection(entry.bitsOffset, (size_t(header.rowCount) + 63) / 64 * sizeof(uint64_t)))
+                return {};
+
+            column.bits = reinterpret_cast<const uint64_t*>(base + entry.bitsOffset);
+        }
+
+        sheet.columns.push_back(column);
+    }
+
+    return sheet;
+}
+
+bool MappedExcelSheet::getBool(const size_t column, const size_t row) const {
+    return (columns.at(column).bits[row / 64] >> (row % 64)) & 1;
+}
+
+std::string_view MappedExcelSheet::getString(const size_t column, const size_t row) const {
+    const auto& c = columns.at(column);
+    return {c.stringArena + c.stringOffsets[row], c.stringOffsets[row + 1] - c.stringOffsets[row]};
+}
+
+int64_t MappedExcelSheet::getInteger(const size_t column, const size_t row) const {
+    switch(columns.at(column).definition.type) {
+        case String:
+            throw std::runtime_error("Column is not an integer.");
+        case Int8:
+            return getValues<int8_t>(column)[row];
+        case UInt8:
+            return getValues<uint8_t>(column)[row];
+        case Int16:
+            return getValues<int16_t>(column)[row];
+        case UInt16:
+            return getValues<uint16_t>(column)[row];
+        case Int32:
+            return getValues<int32_t>(column)[row];
+        case UInt32:
+            return getValues<uint32_t>(column)[row];
+        case Float32:
+            return static_cast<int64_t>(getValues<float>(column)[row]);
+        case Int64:
+            return getValues<int64_t>(column)[row];
+        case UInt64:
+            return static_cast<int64_t>(getValues<uint64_t>(column)[row]);
+        default:
+            return getBool(column, row);
+    }
+}
+
+std::optional<size_t> MappedExcelSheet::findRow(const uint32_t rowId, const uint16_t subrow) const {
+    const uint32_t* it = std::lower_bound(rowIds, rowIds + rowCount, rowId);
+    if(it == rowIds + rowCount || *it != rowId)
+        return {};
+
+    const size_t position = (it - rowIds) + subrow;
+    if(position >= rowCount || rowIds[position] != rowId || subrowIds[position] != subrow)
+        return {};
+
+    return position;
+}
+
+std::string getExcelCachePath(const std::string_view cacheDirectory, const std::string_view sheet, const Language language) {
+    const auto languageCode = getLanguageCode(language);
+    if(languageCode.empty())
+        return fmt::format("{}/{}.xcache", cacheDirectory, sheet);
+
+    return fmt::format("{}/{}_{}.xcache", cacheDirectory, sheet, languageCode);
+}
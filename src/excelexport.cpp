@@ -0,0 +1,448 @@
+#include "excelexport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <fmt/format.h>
+
+#include "columnarsheet.h"
+#include "exdparser.h"
+#include "gamedata.h"
+#include "parallel.h"
+#include "sestring.h"
+#include "string_utils.h"
+#include "utility.h"
+
+/*
+ * The columnar format is little-endian and laid out like this:
+ *
+ * header: magic (XIVE), format version, column count (all uint32)
+ * then for each column: index (uint32), type (uint16), offset (uint16)
+ *
+ * then one block per page: row count (uint32), row ids (uint32[]), subrow ids (uint16[]), then for each column:
+ * - fixed-width columns: the values in native byte order
+ * - bool columns: (rowCount + 63) / 64 uint64 words, one bit per row
+ * - string columns: rowCount + 1 uint32 offsets, then the string bytes (offsets[rowCount] bytes long)
+ *
+ * the file ends with a block that has a row count of 0.
+ */
+constexpr uint32_t exportMagic = 0x45564958; // XIVE
+constexpr uint32_t exportFormatVersion = 1;
+
+// rows are formatted into this buffer and it's flushed to the stream when it gets this big
+constexpr size_t exportFlushSize = 1 << 20;
+
+static std::string_view getExportExtension(const ExcelExportFormat format) {
+    switch(format) {
+        case ExcelExportFormat::CSV:
+            return "csv";
+        case ExcelExportFormat::JSONLines:
+            return "jsonl";
+        case ExcelExportFormat::Columnar:
+            return "xcol";
+    }
+
+    return "";
+}
+
+static void flush(std::string& buffer, std::ostream& out) {
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
+template<typename T>
+static void appendRaw(std::string& buffer, const T& value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+static void appendCSVString(std::string& buffer, const std::string_view string) {
+    buffer += '"';
+
+    // quotes are escaped by doubling them, everything else (including newlines) is fine inside of quotes
+    size_t start = 0;
+    for(size_t quote = string.find('"'); quote != std::string_view::npos; quote = string.find('"', start)) {
+        buffer.append(string.data() + start, quote - start + 1);
+        buffer += '"';
+        start = quote + 1;
+    }
+
+    buffer.append(string.data() + start, string.size() - start);
+    buffer += '"';
+}
+
+// the length of the UTF-8 sequence at the start of string, or 0 if it isn't valid UTF-8
+static size_t getUTF8SequenceLength(const std::string_view string) {
+    const auto lead = static_cast<unsigned char>(string[0]);
+
+    size_t length;
+    uint32_t lowest;
+    if(lead < 0x80)
+        return 1;
+    else if((lead & 0xE0) == 0xC0)
+        length = 2, lowest = 0x80;
+    else if((lead & 0xF0) == 0xE0)
+        length = 3, lowest = 0x800;
+    else if((lead & 0xF8) == 0xF0)
+        length = 4, lowest = 0x10000;
+    else
+        return 0;
+
+    if(string.size() < length)
+        return 0;
+
+    uint32_t codepoint = lead & (0x7F >> length);
+    for(size_t i = 1; i < length; i++) {
+        const auto c = static_cast<unsigned char>(string[i]);
+        if((c & 0xC0) != 0x80)
+            return 0;
+
+        codepoint = codepoint << 6 | (c & 0x3F);
+    }
+
+    // overlong encodings and surrogates aren't valid either
+    if(codepoint < lowest || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+        return 0;
+
+    return length;
+}
+
+static void appendJSONString(std::string& buffer, const std::string_view string) {
+    buffer += '"';
+
+    size_t start = 0;
+    for(size_t i = 0; i < string.size(); i++) {
+        const auto c = static_cast<unsigned char>(string[i]);
+        if(c >= 0x20 && c != '"' && c != '\\' && c < 0x80)
+            continue;
+
+        if(c >= 0x80) {
+            const size_t length = getUTF8SequenceLength(string.substr(i));
+            if(length != 0) {
+                i += length - 1;
+                continue;
+            }
+        }
+
+        buffer.append(string.data() + start, i - start);
+        start = i + 1;
+
+        switch(c) {
+            case '"':
+                buffer += "\\\"";
+                break;
+            case '\\':
+                buffer += "\\\\";
+                break;
+            case '\n':
+                buffer += "\\n";
+                break;
+            case '\r':
+                buffer += "\\r";
+                break;
+            case '\t':
+                buffer += "\\t";
+                break;
+            default:
+                // JSON has to be valid UTF-8, so bytes that aren't part of a valid sequence are replaced
+                if(c >= 0x80)
+                    buffer += "\\ufffd";
+                else
+                    fmt::format_to(std::back_inserter(buffer), "\\u{:04x}", c);
+                break;
+        }
+    }
+
+    buffer.append(string.data() + start, string.size() - start);
+    buffer += '"';
+}
+
+static void appendCell(std::string& buffer, const EXDPage& page, const uint8_t* row,
+                       const ExcelColumnDefinition& column, const ExcelExportFormat format) {
+    const uint8_t* cell = row + column.offset;
+    const auto out = std::back_inserter(buffer);
+
+    switch(column.type) {
+        case String:
+            if(format == ExcelExportFormat::CSV) {
+                appendCSVString(buffer, page.decodeString(row, column));
+            } else {
+                // payloads are binary, so only the text of the string is exported
+                const SeStringView string(page.decodeString(row, column));
+                if(string.hasPayloads())
+                    appendJSONString(buffer, string.toPlainText());
+                else
+                    appendJSONString(buffer, string.getData());
+            }
+            break;
+        case Bool:
+            buffer += readBigEndian<uint8_t>(cell) != 0 ? "true" : "false";
+            break;
+        case Int8:
+            fmt::format_to(out, "{}", readBigEndian<int8_t>(cell));
+            break;
+        case UInt8:
+            fmt::format_to(out, "{}", readBigEndian<uint8_t>(cell));
+            break;
+        case Int16:
+            fmt::format_to(out, "{}", readBigEndian<int16_t>(cell));
+            break;
+        case UInt16:
+            fmt::format_to(out, "{}", readBigEndian<uint16_t>(cell));
+            break;
+        case Int32:
+            fmt::format_to(out, "{}", readBigEndian<int32_t>(cell));
+            break;
+        case UInt32:
+            fmt::format_to(out, "{}", readBigEndian<uint32_t>(cell));
+            break;
+        case Float32: {
+            const auto value = readBigEndian<float>(cell);
+
+            // JSON has no representation for these
+            if(format == ExcelExportFormat::JSONLines && !std::isfinite(value))
+                buffer += "null";
+            else
+                fmt::format_to(out, "{}", value);
+        }
+            break;
+        case Int64:
+            fmt::format_to(out, "{}", readBigEndian<int64_t>(cell));
+            break;
+        case UInt64:
+            fmt::format_to(out, "{}", readBigEndian<uint64_t>(cell));
+            break;
+        default:
+            if(column.type >= PackedBool0 && column.type <= PackedBool7) {
+                const uint8_t mask = 1 << (column.type - PackedBool0);
+                buffer += (readBigEndian<uint8_t>(cell) & mask) != 0 ? "true" : "false";
+            } else {
+                buffer += format == ExcelExportFormat::CSV ? "" : "null";
+            }
+            break;
+    }
+}
+
+static void writeTextHeader(std::string& buffer, const EXH& exh) {
+    // JSON Lines has no header, the column position is the column index
+    buffer += "id,subrow";
+    for(size_t i = 0; i < exh.columnDefinitions.size(); i++)
+        fmt::format_to(std::back_inserter(buffer), ",{}", i);
+
+    buffer += '\n';
+}
+
+static void writeTextPage(std::string& buffer, std::ostream& out, const EXDPage& page, const ExcelExportFormat format) {
+    const auto& columns = page.getColumns();
+
+    for(const auto rowId : page.getRowIds()) {
+        const uint16_t subrowCount = page.getSubrowCount(rowId);
+
+        for(uint16_t subrow = 0; subrow < subrowCount; subrow++) {
+            const uint8_t* row = page.getRowData(rowId, subrow);
+            if(row == nullptr)
+                continue;
+
+            if(format == ExcelExportFormat::CSV) {
+                fmt::format_to(std::back_inserter(buffer), "{},{}", rowId, subrow);
+
+                for(const auto& column : columns) {
+                    buffer += ',';
+                    appendCell(buffer, page, row, column, format);
+                }
+
+                buffer += '\n';
+            } else {
+                fmt::format_to(std::back_inserter(buffer), "{{\"id\":{},\"subrow\":{},\"columns\":[", rowId, subrow);
+
+                for(size_t i = 0; i < columns.size(); i++) {
+                    if(i != 0)
+                        buffer += ',';
+
+                    appendCell(buffer, page, row, columns[i], format);
+                }
+
+                buffer += "]}\n";
+            }
+
+            if(buffer.size() >= exportFlushSize)
+                flush(buffer, out);
+        }
+    }
+}
+
+static void writeColumnarHeader(std::string& buffer, const EXH& exh) {
+    appendRaw(buffer, exportMagic);
+    appendRaw(buffer, exportFormatVersion);
+    appendRaw(buffer, static_cast<uint32_t>(exh.columnDefinitions.size()));
+
+    for(size_t i = 0; i < exh.columnDefinitions.size(); i++) {
+        appendRaw(buffer, static_cast<uint32_t>(i));
+        appendRaw(buffer, static_cast<uint16_t>(exh.columnDefinitions[i].type));
+        appendRaw(buffer, exh.columnDefinitions[i].offset);
+    }
+}
+
+static void writeColumnarPage(std::string& buffer, const EXDPage& page, const ExcelDecodePlan& plan) {
+    // the columnar decoder already swaps and groups the values, and it's only ever one page big
+    ColumnarSheet block;
+    appendColumnarEXD(block, page, plan);
+    const size_t rowCount = block.size();
+
+    appendRaw(buffer, static_cast<uint32_t>(rowCount));
+    buffer.append(reinterpret_cast<const char*>(block.rowIds.data()), rowCount * sizeof(uint32_t));
+    buffer.append(reinterpret_cast<const char*>(block.subrowIds.data()), rowCount * sizeof(uint16_t));
+
+    for(const auto& column : block.columns) {
+        if(column.definition.type == String) {
+            buffer.append(reinterpret_cast<const char*>(column.stringOffsets.data()), column.stringOffsets.size() * sizeof(uint32_t));
+            buffer.append(column.stringArena.data(), column.stringArena.size());
+        } else if(!std::holds_alternative<std::monostate>(column.values)) {
+            std::visit([&buffer](const auto& array) {
+                using T = std::decay_t<decltype(array)>;
+                if constexpr (!std::is_same_v<T, std::monostate>)
+                    buffer.append(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(typename T::value_type));
+            }, column.values);
+        } else {
+            std::vector<uint64_t> bits = column.bits;
+            bits.resize((rowCount + 63) / 64);
+
+            buffer.append(reinterpret_cast<const char*>(bits.data()), bits.size() * sizeof(uint64_t));
+        }
+    }
+}
+
+void exportSheet(GameData& data, const std::string_view sheet, Language language, const ExcelExportFormat format,
+                 std::ostream& out, const ExcelExportCallback& progress) {
+    const EXH* exh = data.getCachedExcelSheet(sheet);
+    if(exh == nullptr)
+        throw std::runtime_error(fmt::format("Sheet {} does not exist.", sheet));
+
+    if(!isLocalized(*exh))
+        language = Language::None;
+
+    std::string buffer;
+    buffer.reserve(exportFlushSize + exportFlushSize / 4);
+
+    if(format == ExcelExportFormat::CSV)
+        writeTextHeader(buffer, *exh);
+    else if(format == ExcelExportFormat::Columnar)
+        writeColumnarHeader(buffer, *exh);
+
+    const std::string lowercaseName = toLowercase(std::string(sheet));
+
+    ExcelExportProgress status;
+    status.sheet = sheet;
+    status.language = language;
+    status.pageCount = exh->pages.size();
+
+    // every page of a sheet has the same layout, so the plan is only compiled once
+    ExcelDecodePlan plan;
+    if(format == ExcelExportFormat::Columnar)
+        plan = compileDecodePlan(exh->columnDefinitions);
+
+    // pages are extracted directly instead of through the page cache, so an export doesn't evict everything else
+    for(const auto& pagination : exh->pages) {
+        const std::string path = "exd/" + getEXDFilename(*exh, lowercaseName, getLanguageCode(language), pagination);
+
+        auto pageData = data.extractFile(path);
+        if(!pageData)
+            throw std::runtime_error("Failed to extract excel page " + path);
+
+        const EXDPage page(*exh, std::move(*pageData));
+
+        if(format == ExcelExportFormat::Columnar)
+            writeColumnarPage(buffer, page, plan);
+        else
+            writeTextPage(buffer, out, page, format);
+
+        flush(buffer, out);
+
+        status.pagesDone++;
+        if(progress)
+            progress(status);
+    }
+
+    if(format == ExcelExportFormat::Columnar) {
+        appendRaw(buffer, static_cast<uint32_t>(0));
+        flush(buffer, out);
+    }
+
+    if(!out)
+        throw std::runtime_error(fmt::format("Failed to write the export of {}.", sheet));
+}
+
+void exportSheets(GameData& data, const std::vector<std::string>& sheets, const std::vector<Language>& languages,
+                  const std::string_view directory, const ExcelExportFormat format, const ExcelExportCallback& progress,
+                  const size_t threadCount) {
+    struct Job {
+        std::string_view sheet;
+        Language language;
+    };
+
+    std::vector<Job> jobs;
+    for(const auto& sheet : sheets) {
+        const EXH* exh = data.getCachedExcelSheet(sheet);
+        if(exh == nullptr)
+            throw std::runtime_error(fmt::format("Sheet {} does not exist.", sheet));
+
+        if(!isLocalized(*exh)) {
+            jobs.push_back({sheet, Language::None});
+            continue;
+        }
+
+        for(const auto language : languages) {
+            if(std::find(exh->language.begin(), exh->language.end(), language) != exh->language.end())
+                jobs.push_back({sheet, language});
+        }
+    }
+
+    std::mutex progressMutex;
+    std::atomic<size_t> sheetsDone = 0;
+
+    parallelFor(jobs.size(), [&](const size_t i) {
+        const auto& job = jobs[i];
+
+        const std::filesystem::path path = getExcelExportPath(directory, job.sheet, job.language, format);
+        std::filesystem::create_directories(path.parent_path());
+
+        std::ofstream file(path, std::ios::binary);
+        if(!file)
+            throw std::runtime_error("Failed to open " + path.string() + " for writing.");
+
+        const auto report = [&](ExcelExportProgress status) {
+            if(!progress)
+                return;
+
+            status.sheetsDone = sheetsDone;
+            status.sheetCount = jobs.size();
+
+            std::lock_guard lock(progressMutex);
+            progress(status);
+        };
+
+        ExcelExportProgress lastStatus;
+        lastStatus.sheet = job.sheet;
+        lastStatus.language = job.language;
+
+        exportSheet(data, job.sheet, job.language, format, file, [&](const ExcelExportProgress& status) {
+            lastStatus = status;
+            report(status);
+        });
+
+        // counted here instead of on the last page, sheets without any pages still have to finish
+        sheetsDone++;
+        report(lastStatus);
+    }, threadCount);
+}
+
+std::string getExcelExportPath(const std::string_view directory, const std::string_view sheet, const Language language, const ExcelExportFormat format) {
+    const auto languageCode = getLanguageCode(language);
+    if(languageCode.empty())
+        return fmt::format("{}/{}.{}", directory, sheet, getExportExtension(format));
+
+    return fmt::format("{}/{}_{}.{}", directory, sheet, languageCode, getExportExtension(format));
+}
@@ -0,0 +1,297 @@
+#include "excelindex.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <numeric>
+#include <stdexcept>
+#include <fmt/format.h>
+
+#include "columnarsheet.h"
+#include "memorybuffer.h"
+
+constexpr uint32_t indexMagic = 0x49564958; // XIVI
+constexpr uint32_t indexFormatVersion = 1;
+
+static uint64_t hashKey(const int64_t key) {
+    return static_cast<uint64_t>(key);
+}
+
+static uint64_t hashKey(const std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+}
+
+std::vector<uint32_t> ExcelIndex::find(const int64_t value) const {
+    std::vector<uint32_t> result;
+
+    if(isString)
+        throw std::runtime_error("This index is over a string column.");
+
+    if(type == ExcelIndexType::Hash) {
+        const auto [begin, end] = buckets.equal_range(hashKey(value));
+        for(auto it = begin; it != end; ++it)
+            result.push_back(rowIds[it->second]);
+
+        // the multimap doesn't keep insertion order
+        std::sort(result.begin(), result.end());
+    } else {
+        const auto [begin, end] = std::equal_range(keys.begin(), keys.end(), value);
+        for(auto it = begin; it != end; ++it)
+            result.push_back(rowIds[it - keys.begin()]);
+    }
+
+    return result;
+}
+
+std::vector<uint32_t> ExcelIndex::find(const std::string_view value) const {
+    std::vector<uint32_t> result;
+
+    if(!isString)
+        throw std::runtime_error("This index is not over a string column.");
+
+    if(type == ExcelIndexType::Hash) {
+        const auto [begin, end] = buckets.equal_range(hashKey(value));
+        for(auto it = begin; it != end; ++it) {
+            // different strings can have the same hash
+            if(stringKeys[it->second] == value)
+                result.push_back(rowIds[it->second]);
+        }
+
+        std::sort(result.begin(), result.end());
+    } else {
+        const auto [begin, end] = std::equal_range(stringKeys.begin(), stringKeys.end(), value,
+                                                   [](const auto& a, const auto& b) {
+            return std::string_view(a) < std::string_view(b);
+        });
+
+        for(auto it = begin; it != end; ++it)
+            result.push_back(rowIds[it - stringKeys.begin()]);
+    }
+
+    return result;
+}
+
+std::vector<uint32_t> ExcelIndex::findRange(const int64_t min, const int64_t max) const {
+    if(type != ExcelIndexType::Sorted || isString)
+        throw std::runtime_error("Range lookups are only supported by sorted indexes over numeric columns.");
+
+    std::vector<uint32_t> result;
+
+    const auto begin = std::lower_bound(keys.begin(), keys.end(), min);
+    const auto end = std::upper_bound(keys.begin(), keys.end(), max);
+    for(auto it = begin; it < end; ++it)
+        result.push_back(rowIds[it - keys.begin()]);
+
+    return result;
+}
+
+void ExcelIndex::buildBuckets() {
+    buckets.clear();
+
+    if(type != ExcelIndexType::Hash)
+        return;
+
+    buckets.reserve(rowIds.size());
+
+    for(uint32_t i = 0; i < rowIds.size(); i++) {
+        if(isString)
+            buckets.emplace(hashKey(stringKeys[i]), i);
+        else
+            buckets.emplace(hashKey(keys[i]), i);
+    }
+}
+
+ExcelIndex buildExcelIndex(const ExcelSheet& sheet, const size_t column, const ExcelIndexType type, const Language language) {
+    if(sheet.data.empty())
+        throw std::runtime_error("Sheet " + sheet.name + " has no data loaded.");
+
+    const ColumnarSheet* data = sheet.getLanguage(language);
+
+    // numeric columns are the same in every language, and some sheets aren't localized at all
+    if(data == nullptr)
+        data = &sheet.data.front();
+
+    const auto columnData = std::find_if(data->columns.begin(), data->columns.end(), [column](const ExcelColumn& c) {
+        return c.index == column;
+    });
+
+    if(columnData == data->columns.end())
+        throw std::runtime_error(fmt::format("Column {} of {} is not loaded.", column, sheet.name));
+
+    ExcelIndex index;
+    index.type = type;
+    index.sheet = sheet.name;
+    index.column = column;
+    index.isString = columnData->definition.type == String;
+
+    if(index.isString) {
+        if(sheet.getLanguage(language) == nullptr)
+            throw std::runtime_error(fmt::format("Sheet {} is not loaded in {}.", sheet.name, getLanguageCode(language)));
+
+        index.language = language;
+    }
+
+    const size_t rowCount = data->size();
+
+    // sorted indexes are built by sorting the row positions by their key
+    std::vector<uint32_t> order(rowCount);
+    std::iota(order.begin(), order.end(), 0);
+
+    if(index.isString) {
+        if(type == ExcelIndexType::Sorted) {
+            std::stable_sort(order.begin(), order.end(), [&columnData](const uint32_t a, const uint32_t b) {
+                return columnData->getString(a) < columnData->getString(b);
+            });
+        }
+
+        index.stringKeys.reserve(rowCount);
+        for(const auto i : order)
+            index.stringKeys.emplace_back(columnData->getString(i));
+    } else {
+        std::vector<int64_t> values(rowCount);
+        for(size_t i = 0; i < rowCount; i++)
+            values[i] = columnData->getInteger(i);
+
+        if(type == ExcelIndexType::Sorted) {
+            std::stable_sort(order.begin(), order.end(), [&values](const uint32_t a, const uint32_t b) {
+                return values[a] < values[b];
+            });
+        }
+
+        index.keys.reserve(rowCount);
+        for(const auto i : order)
+            index.keys.push_back(values[i]);
+    }
+
+    index.rowIds.reserve(rowCount);
+    for(const auto i : order)
+        index.rowIds.push_back(data->rowIds[i]);
+
+    index.buildBuckets();
+
+    return index;
+}
+
+std::string getExcelIndexPath(const std::string_view cacheDirectory, const ExcelIndex& index) {
+    return getExcelIndexPath(cacheDirectory, index.sheet, index.column, index.language);
+}
+
+std::string getExcelIndexPath(const std::string_view cacheDirectory, const std::string_view sheet, const size_t column, const Language language) {
+    const auto languageCode = getLanguageCode(language);
+    if(languageCode.empty())
+        return fmt::format("{}/{}_{}.idx", cacheDirectory, sheet, column);
+
+    return fmt::format("{}/{}_{}_{}.idx", cacheDirectory, sheet, column, languageCode);
+}
+
+static void writeString(MemoryBuffer& buffer, const std::string_view string) {
+    buffer.write(static_cast<uint32_t>(string.size()));
+    buffer.write_bytes(string.data(), string.size());
+}
+
+template<typename T>
+static T readValue(MemorySpan& span) {
+    if(span.current_position() + sizeof(T) > span.size())
+        throw std::runtime_error("Excel index is truncated.");
+
+    T value;
+    span.read(&value);
+
+    return value;
+}
+
+static std::string readString(MemorySpan& span) {
+    const auto length = readValue<uint32_t>(span);
+
+    if(span.current_position() + length > span.size())
+        throw std::runtime_error("Excel index is truncated.");
+
+    std::string string(reinterpret_cast<const char*>(span.raw_data() + span.current_position()), length);
+    span.seek(length, Seek::Current);
+
+    return string;
+}
+
+void writeExcelIndex(const ExcelIndex& index, const std::string_view path, const std::string_view version) {
+    MemoryBuffer buffer;
+
+    buffer.write(indexMagic);
+    buffer.write(indexFormatVersion);
+    writeString(buffer, version);
+    writeString(buffer, index.sheet);
+
+    buffer.write(static_cast<uint8_t>(index.type));
+    buffer.write(static_cast<uint8_t>(index.isString));
+    buffer.write(static_cast<uint16_t>(index.language));
+    buffer.write(static_cast<uint32_t>(index.column));
+    buffer.write(static_cast<uint32_t>(index.rowIds.size()));
+
+    buffer.write_bytes(index.rowIds.data(), index.rowIds.size() * sizeof(uint32_t));
+
+    if(index.isString) {
+        for(const auto& key : index.stringKeys)
+            writeString(buffer, key);
+    } else {
+        buffer.write_bytes(index.keys.data(), index.keys.size() * sizeof(int64_t));
+    }
+
+    write_buffer_to_file(buffer, path);
+}
+
+std::optional<ExcelIndex> readExcelIndex(const std::string_view path, const std::string_view version) {
+    if(!std::filesystem::exists(path))
+        return {};
+
+    const MemoryBuffer buffer = read_file_to_buffer(path);
+    MemorySpan span(buffer);
+
+    // anything too short to even have a header isn't an index written by us
+    if(buffer.size() < sizeof(uint32_t) * 2)
+        return {};
+
+    const auto magic = readValue<uint32_t>(span);
+    const auto formatVersion = readValue<uint32_t>(span);
+
+    if(magic != indexMagic || formatVersion != indexFormatVersion)
+        return {};
+
+    if(readString(span) != version)
+        return {};
+
+    ExcelIndex index;
+    index.sheet = readString(span);
+
+    const auto type = readValue<uint8_t>(span);
+    const auto isString = readValue<uint8_t>(span);
+    const auto language = readValue<uint16_t>(span);
+    const auto column = readValue<uint32_t>(span);
+    const auto count = readValue<uint32_t>(span);
+
+    if(type != static_cast<uint8_t>(ExcelIndexType::Hash) && type != static_cast<uint8_t>(ExcelIndexType::Sorted))
+        throw std::runtime_error("Excel index has an unknown type.");
+
+    index.type = static_cast<ExcelIndexType>(type);
+    index.isString = isString;
+    index.language = static_cast<Language>(language);
+    index.column = column;
+
+    const size_t fixedSize = count * sizeof(uint32_t) + (isString ? 0 : count * sizeof(int64_t));
+    if(span.current_position() + fixedSize > span.size())
+        throw std::runtime_error("Excel index is truncated.");
+
+    index.rowIds.resize(count);
+    memcpy(index.rowIds.data(), span.raw_data() + span.current_position(), count * sizeof(uint32_t));
+    span.seek(count * sizeof(uint32_t), Seek::Current);
+
+    if(isString) {
+        index.stringKeys.reserve(count);
+        for(uint32_t i = 0; i < count; i++)
+            index.stringKeys.push_back(readString(span));
+    } else {
+        index.keys.resize(count);
+        memcpy(index.keys.data(), span.raw_data() + span.current_position(), count * sizeof(int64_t));
+    }
+
+    index.buildBuckets();
+
+    return index;
+}
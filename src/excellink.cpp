@@ -0,0 +1,94 @@
+#include "excellink.h"
+
+#include <fmt/format.h>
+
+#include "gamedata.h"
+
+static std::string getLinkKey(const std::string_view sheet, const size_t column) {
+    return fmt::format("{}:{}", sheet, column);
+}
+
+ExcelLinkResolver::ExcelLinkResolver(GameData& data, const size_t rowCacheCapacity) : data(data), rowCache(rowCacheCapacity) {}
+
+void ExcelLinkResolver::addLink(const std::string_view sheet, const size_t column, const std::string_view targetSheet) {
+    std::lock_guard lock(linksMutex);
+    links[getLinkKey(sheet, column)] = targetSheet;
+}
+
+std::string ExcelLinkResolver::getLinkTarget(const std::string_view sheet, const size_t column) {
+    std::lock_guard lock(linksMutex);
+
+    const auto it = links.find(getLinkKey(sheet, column));
+    if(it == links.end())
+        return {};
+
+    return it->second;
+}
+
+std::shared_ptr<const Row> ExcelLinkResolver::getRow(const std::string_view sheet, const uint32_t rowId, const uint16_t subrow, Language language) {
+    const EXH* exh = data.getCachedExcelSheet(sheet);
+    if(exh == nullptr)
+        return nullptr;
+
+    // unlocalized sheets are the same in every language, so they should share cache entries
+    if(!isLocalized(*exh))
+        language = Language::None;
+
+    const std::string key = fmt::format("{}#{}.{}@{}", sheet, rowId, subrow, getLanguageCode(language));
+
+    if(auto cached = rowCache.get(key))
+        return *cached;
+
+    auto row = data.getSubrow(sheet, rowId, subrow, language);
+    if(!row)
+        return nullptr;
+
+    auto sharedRow = std::make_shared<const Row>(std::move(*row));
+    rowCache.put(key, sharedRow);
+
+    return sharedRow;
+}
+
+std::shared_ptr<const Row> ExcelLinkResolver::follow(const std::string_view sheet, const uint32_t rowId, const size_t column, const Language language) {
+    const std::string targetSheet = getLinkTarget(sheet, column);
+    if(targetSheet.empty())
+        return nullptr;
+
+    const auto row = getRow(sheet, rowId, 0, language);
+    if(row == nullptr)
+        return nullptr;
+
+    return follow(sheet, *row, column, targetSheet, language);
+}
+
+std::shared_ptr<const Row> ExcelLinkResolver::follow(const std::string_view sheet, const Row& row, const size_t column,
+                                                     const std::string_view targetSheet, const Language language) {
+    const EXH* exh = data.getCachedExcelSheet(sheet);
+    if(exh == nullptr)
+        return nullptr;
+
+    // only integer columns can hold row ids
+    switch(exh->columnDefinitions.at(column).type) {
+        case Int8:
+        case UInt8:
+        case Int16:
+        case UInt16:
+        case Int32:
+        case UInt32:
+        case Int64:
+        case UInt64:
+            break;
+        default:
+            return nullptr;
+    }
+
+    const auto& key = row.data.at(column);
+    if(key.uint64Data < 0)
+        return nullptr;
+
+    return getRow(targetSheet, static_cast<uint32_t>(key.uint64Data), 0, language);
+}
+
+void ExcelLinkResolver::clear() {
+    rowCache.clear();
+}
@@ -0,0 +1,151 @@
+#include "excelpagestore.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <fmt/format.h>
+
+#include "compression.h"
+#include "gamedata.h"
+#include "parallel.h"
+#include "string_utils.h"
+
+ExcelPageStore::ExcelPageStore(GameData& data, const int compressionLevel) : data(data), compressionLevel(compressionLevel) {}
+
+static std::string getPagePath(const EXH& exh, const std::string_view sheet, const Language language, const ExcelDataPagination& page) {
+    return "exd/" + getEXDFilename(exh, toLowercase(std::string(sheet)), getLanguageCode(language), page);
+}
+
+void ExcelPageStore::addSheet(const std::string_view sheet, const std::vector<Language>& languages) {
+    const EXH* exh = data.getCachedExcelSheet(sheet);
+    if(exh == nullptr)
+        throw std::runtime_error(fmt::format("Sheet {} does not exist.", sheet));
+
+    std::vector<Language> sheetLanguages;
+    if(isLocalized(*exh)) {
+        for(const auto language : languages) {
+            if(std::find(exh->language.begin(), exh->language.end(), language) == exh->language.end())
+                throw std::runtime_error(fmt::format("Sheet {} is not available in {}.", sheet, getLanguageCode(language)));
+
+            sheetLanguages.push_back(language);
+        }
+    } else {
+        sheetLanguages.push_back(Language::None);
+    }
+
+    const size_t pageCount = exh->pages.size();
+
+    std::vector<std::string> paths(sheetLanguages.size() * pageCount);
+    std::vector<StoredPage> storedPages(paths.size());
+
+    parallelFor(paths.size(), [&](const size_t i) {
+        paths[i] = getPagePath(*exh, sheet, sheetLanguages[i / pageCount], exh->pages[i % pageCount]);
+
+        auto pageData = data.extractFile(paths[i]);
+        if(!pageData)
+            throw std::runtime_error("Failed to extract excel page " + paths[i]);
+
+        auto& page = storedPages[i];
+        page.exh = exh;
+        page.size = pageData->size();
+#ifdef LZ4_SUPPORTED
+        page.data = lz4::block_compress(pageData->data.data(), page.size);
+#else
+        page.data = zlib::no_header_compress(pageData->data.data(), page.size, compressionLevel);
+#endif
+        page.data.shrink_to_fit();
+    });
+
+    std::lock_guard lock(pagesMutex);
+
+    for(size_t i = 0; i < paths.size(); i++) {
+        // re-adding a sheet replaces its pages
+        if(const auto existing = pages.find(paths[i]); existing != pages.end()) {
+            compressedSize -= existing->second->data.size();
+            uncompressedSize -= existing->second->size;
+            pages.erase(existing);
+        }
+
+        compressedSize += storedPages[i].data.size();
+        uncompressedSize += storedPages[i].size;
+
+        pages.emplace(std::move(paths[i]), std::make_shared<const StoredPage>(std::move(storedPages[i])));
+    }
+}
+
+std::optional<EXDPage> ExcelPageStore::getPage(const std::string_view sheet, const uint32_t rowId, Language language) {
+    const EXH* exh = data.getCachedExcelSheet(sheet);
+    if(exh == nullptr)
+        return {};
+
+    // pages are sorted by their starting row id, so the row is in the last page that starts before it
+    auto pagination = std::upper_bound(exh->pages.begin(), exh->pages.end(), rowId,
+                                       [](const uint32_t id, const ExcelDataPagination& page) {
+        return id < page.startId;
+    });
+
+    if(pagination == exh->pages.begin())
+        return {};
+
+    --pagination;
+
+    if(!isLocalized(*exh))
+        language = Language::None;
+
+    std::shared_ptr<const StoredPage> page;
+    {
+        std::lock_guard lock(pagesMutex);
+
+        const auto it = pages.find(getPagePath(*exh, sheet, language, *pagination));
+        if(it == pages.end())
+            return {};
+
+        // holding a reference keeps the page alive even if the sheet is re-added meanwhile
+        page = it->second;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // lookups tend to hit the same page over and over, so the last page inflated on this thread is kept around.
+    // holding a reference to it means the pointer can't be reused by another page while it's cached.
+    thread_local std::vector<uint8_t> scratch;
+    thread_local std::shared_ptr<const StoredPage> scratchPage;
+
+    if(scratchPage != page) {
+        scratchPage.reset();
+        scratch.resize(page->size);
+
+#ifdef LZ4_SUPPORTED
+        lz4::block_decompress(page->data.data(), page->data.size(), scratch.data(), page->size);
+#else
+        zlib::no_header_decompress(const_cast<uint8_t*>(page->data.data()), page->data.size(), scratch.data(), page->size);
+#endif
+
+        scratchPage = page;
+    }
+
+    EXDPage exdPage(*page->exh, scratch.data(), page->size);
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    accessNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    accessCount++;
+
+    return exdPage;
+}
+
+ExcelPageStoreStats ExcelPageStore::getStats() const {
+    ExcelPageStoreStats stats;
+
+    {
+        std::lock_guard lock(pagesMutex);
+
+        stats.pageCount = pages.size();
+        stats.compressedSize = compressedSize;
+        stats.uncompressedSize = uncompressedSize;
+    }
+
+    stats.accessCount = accessCount;
+    stats.accessNanoseconds = accessNanoseconds;
+
+    return stats;
+}
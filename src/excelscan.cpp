@@ -0,0 +1,401 @@
+#include "excelscan.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define XIV_SCAN_SSE2
+#endif
+
+#include "exdparser.h"
+#include "gamedata.h"
+#include "utility.h"
+
+// values are gathered out of the rows in batches, which fill exactly one mask word
+constexpr size_t batchSize = 64;
+
+void RowBitset::set(const size_t rowId) {
+    if(rowId >= size) {
+        size = rowId + 1;
+        words.resize((size + 63) / 64);
+    }
+
+    words[rowId / 64] |= uint64_t(1) << (rowId % 64);
+}
+
+size_t RowBitset::count() const {
+    size_t count = 0;
+    for(auto word : words) {
+        while(word != 0) {
+            word &= word - 1;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+std::vector<uint32_t> RowBitset::toRowIds() const {
+    std::vector<uint32_t> rowIds;
+    for(size_t i = 0; i < words.size(); i++) {
+        if(words[i] == 0)
+            continue;
+
+        for(size_t j = 0; j < 64; j++) {
+            if((words[i] >> j) & 1)
+                rowIds.push_back(i * 64 + j);
+        }
+    }
+
+    return rowIds;
+}
+
+RowBitset& RowBitset::operator&=(const RowBitset& other) {
+    for(size_t i = 0; i < words.size(); i++)
+        words[i] &= i < other.words.size() ? other.words[i] : 0;
+
+    return *this;
+}
+
+RowBitset& RowBitset::operator|=(const RowBitset& other) {
+    if(other.size > size) {
+        size = other.size;
+        words.resize(other.words.size());
+    }
+
+    for(size_t i = 0; i < other.words.size(); i++)
+        words[i] |= other.words[i];
+
+    return *this;
+}
+
+RowBitset operator&(RowBitset a, const RowBitset& b) {
+    a &= b;
+    return a;
+}
+
+RowBitset operator|(RowBitset a, const RowBitset& b) {
+    a |= b;
+    return a;
+}
+
+// swaps big endian values in place, and flips the bits in bias afterwards
+static void byteSwapBatch(uint32_t* values, const size_t count, const uint32_t bias) {
+    size_t i = 0;
+
+#ifdef XIV_SCAN_SSE2
+    const __m128i biasVector = _mm_set1_epi32((int32_t)bias);
+    for(; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+
+        // swap the bytes in each 16-bit word, then swap the two words in each 32-bit value
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+        v = _mm_xor_si128(v, biasVector);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), v);
+    }
+#endif
+
+    for(; i < count; i++)
+        values[i] = byteSwap(values[i]) ^ bias;
+}
+
+static uint64_t matchInt32(const uint32_t* values, const size_t count, const int32_t min, const int32_t max) {
+    uint64_t mask = 0;
+    size_t i = 0;
+
+#ifdef XIV_SCAN_SSE2
+    const __m128i minVector = _mm_set1_epi32(min);
+    const __m128i maxVector = _mm_set1_epi32(max);
+    for(; i + 4 <= count; i += 4) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        const __m128i outside = _mm_or_si128(_mm_cmplt_epi32(v, minVector), _mm_cmpgt_epi32(v, maxVector));
+
+        const auto bits = (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(outside));
+        mask |= (~bits & 0xF) << i;
+    }
+#endif
+
+    for(; i < count; i++) {
+        const auto value = (int32_t)values[i];
+        if(value >= min && value <= max)
+            mask |= uint64_t(1) << i;
+    }
+
+    return mask;
+}
+
+static uint64_t matchFloat(const uint32_t* values, const size_t count, const float min, const float max) {
+    uint64_t mask = 0;
+    size_t i = 0;
+
+#ifdef XIV_SCAN_SSE2
+    const __m128 minVector = _mm_set1_ps(min);
+    const __m128 maxVector = _mm_set1_ps(max);
+    for(; i + 4 <= count; i += 4) {
+        const __m128 v = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i)));
+        const __m128 inside = _mm_and_ps(_mm_cmpge_ps(v, minVector), _mm_cmple_ps(v, maxVector));
+
+        mask |= (uint64_t)_mm_movemask_ps(inside) << i;
+    }
+#endif
+
+    for(; i < count; i++) {
+        float value;
+        memcpy(&value, values + i, sizeof(float));
+        if(value >= min && value <= max)
+            mask |= uint64_t(1) << i;
+    }
+
+    return mask;
+}
+
+template<typename T>
+static uint64_t matchInt64(const std::vector<const uint8_t*>& rows, const size_t start, const size_t count,
+                           const uint16_t offset, const T min, const T max) {
+    uint64_t mask = 0;
+    for(size_t i = 0; i < count; i++) {
+        const auto value = readBigEndian<T>(rows[start + i] + offset);
+        if(value >= min && value <= max)
+            mask |= uint64_t(1) << i;
+    }
+
+    return mask;
+}
+
+template<typename T>
+static void gatherNarrow(const std::vector<const uint8_t*>& rows, const size_t start, const size_t count,
+                         const uint16_t offset, uint32_t* values) {
+    for(size_t i = 0; i < count; i++)
+        values[i] = (uint32_t)(int32_t)readBigEndian<T>(rows[start + i] + offset);
+}
+
+// 2^63 and 2^64, the first doubles that don't fit in int64_t and uint64_t
+constexpr double int64Limit = 9223372036854775808.0;
+constexpr double uint64Limit = 18446744073709551616.0;
+
+/*
+ * These convert the predicate's bounds to the type the column is compared as, and return false if nothing can
+ * match. Integer columns only hold whole numbers, so fractional bounds are rounded inwards.
+ */
+static bool getSignedBounds(const ExcelPredicate& predicate, int64_t& min, int64_t& max) {
+    switch(predicate.boundType) {
+        case ExcelPredicate::BoundType::Signed:
+            min = predicate.min;
+            max = predicate.max;
+            break;
+        case ExcelPredicate::BoundType::Unsigned:
+            if(predicate.unsignedMin > (uint64_t)std::numeric_limits<int64_t>::max())
+                return false;
+
+            min = (int64_t)predicate.unsignedMin;
+            max = (int64_t)std::min<uint64_t>(predicate.unsignedMax, std::numeric_limits<int64_t>::max());
+            break;
+        case ExcelPredicate::BoundType::Float: {
+            const double lower = std::ceil(predicate.floatMin);
+            const double upper = std::floor(predicate.floatMax);
+            if(std::isnan(lower) || std::isnan(upper) || lower >= int64Limit || upper < -int64Limit)
+                return false;
+
+            min = lower <= -int64Limit ? std::numeric_limits<int64_t>::min() : (int64_t)lower;
+            max = upper >= int64Limit ? std::numeric_limits<int64_t>::max() : (int64_t)upper;
+        }
+            break;
+    }
+
+    return min <= max;
+}
+
+static bool getUnsignedBounds(const ExcelPredicate& predicate, uint64_t& min, uint64_t& max) {
+    switch(predicate.boundType) {
+        case ExcelPredicate::BoundType::Signed:
+            if(predicate.max < 0)
+                return false;
+
+            // atLeast() leaves the maximum at INT64_MAX, which is meant as no upper bound at all
+            min = (uint64_t)std::max<int64_t>(predicate.min, 0);
+            max = predicate.max == std::numeric_limits<int64_t>::max() ? std::numeric_limits<uint64_t>::max() : (uint64_t)predicate.max;
+            break;
+        case ExcelPredicate::BoundType::Unsigned:
+            min = predicate.unsignedMin;
+            max = predicate.unsignedMax;
+            break;
+        case ExcelPredicate::BoundType::Float: {
+            const double lower = std::ceil(predicate.floatMin);
+            const double upper = std::floor(predicate.floatMax);
+            if(std::isnan(lower) || std::isnan(upper) || lower >= uint64Limit || upper < 0.0)
+                return false;
+
+            min = lower <= 0.0 ? 0 : (uint64_t)lower;
+            max = upper >= uint64Limit ? std::numeric_limits<uint64_t>::max() : (uint64_t)upper;
+        }
+            break;
+    }
+
+    return min <= max;
+}
+
+// the smallest float >= value, or the largest float <= value when rounding down
+static float toFloatBound(const double value, const bool roundUp) {
+    if(value > std::numeric_limits<float>::max())
+        return roundUp ? std::numeric_limits<float>::infinity() : std::numeric_limits<float>::max();
+
+    if(value < -std::numeric_limits<float>::max())
+        return roundUp ? -std::numeric_limits<float>::max() : -std::numeric_limits<float>::infinity();
+
+    auto result = (float)value;
+    if(roundUp && (double)result < value)
+        result = std::nextafter(result, std::numeric_limits<float>::infinity());
+    else if(!roundUp && (double)result > value)
+        result = std::nextafter(result, -std::numeric_limits<float>::infinity());
+
+    return result;
+}
+
+static bool getFloatBounds(const ExcelPredicate& predicate, float& min, float& max) {
+    double lower = predicate.floatMin, upper = predicate.floatMax;
+    if(predicate.boundType == ExcelPredicate::BoundType::Signed) {
+        // the limits of int64_t are the open bounds of atLeast() and atMost()
+        lower = predicate.min == std::numeric_limits<int64_t>::min() ? -INFINITY : (double)predicate.min;
+        upper = predicate.max == std::numeric_limits<int64_t>::max() ? INFINITY : (double)predicate.max;
+    } else if(predicate.boundType == ExcelPredicate::BoundType::Unsigned) {
+        lower = (double)predicate.unsignedMin;
+        upper = (double)predicate.unsignedMax;
+    }
+
+    if(std::isnan(lower) || std::isnan(upper))
+        return false;
+
+    min = std::isinf(lower) ? (float)lower : toFloatBound(lower, true);
+    max = std::isinf(upper) ? (float)upper : toFloatBound(upper, false);
+
+    return min <= max;
+}
+
+RowBitset scanPage(const EXDPage& page, const ExcelPredicate& predicate) {
+    const auto& column = page.getColumns().at(predicate.column);
+    if(column.type == String)
+        throw std::runtime_error("String columns can't be scanned with a range predicate.");
+
+    std::vector<uint32_t> rowIds;
+    std::vector<const uint8_t*> rows;
+    for(const auto rowId : page.getRowIds()) {
+        const uint16_t subrowCount = page.getSubrowCount(rowId);
+        for(uint16_t i = 0; i < subrowCount; i++) {
+            rowIds.push_back(rowId);
+            rows.push_back(page.getRowData(rowId, i));
+        }
+    }
+
+    RowBitset result(rowIds.empty() ? 0 : page.getRowIds().back() + 1);
+
+    // everything that fits in 32 bits is compared as int32, unsigned 32-bit values are biased into that range
+    const bool isUnsigned32 = column.type == UInt32;
+    const int64_t lowest = isUnsigned32 ? 0 : std::numeric_limits<int32_t>::min();
+    const int64_t highest = isUnsigned32 ? std::numeric_limits<uint32_t>::max() : std::numeric_limits<int32_t>::max();
+    const int64_t bias = isUnsigned32 ? int64_t(1) << 31 : 0;
+
+    int64_t min = 0, max = 0;
+    uint64_t unsignedMin = 0, unsignedMax = 0;
+    float floatMin = 0.0f, floatMax = 0.0f;
+
+    bool hasMatches;
+    if(column.type == Float32)
+        hasMatches = getFloatBounds(predicate, floatMin, floatMax);
+    else if(column.type == UInt64)
+        hasMatches = getUnsignedBounds(predicate, unsignedMin, unsignedMax);
+    else
+        hasMatches = getSignedBounds(predicate, min, max) && (column.type == Int64 || (max >= lowest && min <= highest));
+
+    if(!hasMatches)
+        return result;
+
+    const auto min32 = (int32_t)(std::clamp(min, lowest, highest) - bias);
+    const auto max32 = (int32_t)(std::clamp(max, lowest, highest) - bias);
+
+    uint32_t values[batchSize];
+    for(size_t start = 0; start < rows.size(); start += batchSize) {
+        const size_t count = std::min(batchSize, rows.size() - start);
+
+        uint64_t mask = 0;
+        switch(column.type) {
+            case Int8:
+                gatherNarrow<int8_t>(rows, start, count, column.offset, values);
+                mask = matchInt32(values, count, min32, max32);
+                break;
+            case UInt8:
+                gatherNarrow<uint8_t>(rows, start, count, column.offset, values);
+                mask = matchInt32(values, count, min32, max32);
+                break;
+            case Int16:
+                gatherNarrow<int16_t>(rows, start, count, column.offset, values);
+                mask = matchInt32(values, count, min32, max32);
+                break;
+            case UInt16:
+                gatherNarrow<uint16_t>(rows, start, count, column.offset, values);
+                mask = matchInt32(values, count, min32, max32);
+                break;
+            case Int32:
+            case UInt32:
+                for(size_t i = 0; i < count; i++)
+                    memcpy(values + i, rows[start + i] + column.offset, sizeof(uint32_t));
+
+                byteSwapBatch(values, count, (uint32_t)bias);
+                mask = matchInt32(values, count, min32, max32);
+                break;
+            case Float32:
+                for(size_t i = 0; i < count; i++)
+                    memcpy(values + i, rows[start + i] + column.offset, sizeof(uint32_t));
+
+                byteSwapBatch(values, count, 0);
+                mask = matchFloat(values, count, floatMin, floatMax);
+                break;
+            case Int64:
+                mask = matchInt64<int64_t>(rows, start, count, column.offset, min, max);
+                break;
+            case UInt64:
+                mask = matchInt64<uint64_t>(rows, start, count, column.offset, unsignedMin, unsignedMax);
+                break;
+            default: {
+                // Bool, PackedBool and unknown types
+                uint8_t bit = 0;
+                if(column.type == Bool)
+                    bit = 0xFF;
+                else if(column.type >= PackedBool0 && column.type <= PackedBool7)
+                    bit = 1 << (column.type - PackedBool0);
+
+                for(size_t i = 0; i < count; i++)
+                    values[i] = (rows[start + i][column.offset] & bit) != 0;
+
+                mask = matchInt32(values, count, min32, max32);
+            }
+                break;
+        }
+
+        for(size_t i = 0; mask != 0; i++, mask >>= 1) {
+            if(mask & 1)
+                result.set(rowIds[start + i]);
+        }
+    }
+
+    return result;
+}
+
+RowBitset scanSheet(GameData& data, const std::string_view sheet, const ExcelPredicate& predicate, const Language language) {
+    RowBitset result;
+
+    const EXH* exh = data.getCachedExcelSheet(sheet);
+    if(exh == nullptr)
+        return result;
+
+    for(const auto& pagination : exh->pages) {
+        const auto page = data.getPage(sheet, pagination.startId, language);
+        if(page != nullptr)
+            result |= scanPage(*page, predicate);
+    }
+
+    return result;
+}
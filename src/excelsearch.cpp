@@ -0,0 +1,345 @@
+#include "excelsearch.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <fmt/format.h>
+
+#include "columnarsheet.h"
+#include "memorybuffer.h"
+#include "sestring.h"
+
+constexpr uint32_t searchMagic = 0x53564958; // XIVS
+constexpr uint32_t searchFormatVersion = 1;
+
+static void normalize(std::string& text) {
+    // only ASCII is folded, so multi-byte UTF-8 sequences are never touched
+    for(auto& c : text) {
+        if(c >= 'A' && c <= 'Z')
+            c = static_cast<char>(c - 'A' + 'a');
+    }
+}
+
+static uint32_t getTrigram(const std::string_view text, const size_t position) {
+    return static_cast<uint32_t>(static_cast<uint8_t>(text[position])) << 16 |
+           static_cast<uint32_t>(static_cast<uint8_t>(text[position + 1])) << 8 |
+           static_cast<uint32_t>(static_cast<uint8_t>(text[position + 2]));
+}
+
+void ExcelSearchIndex::setSheet(const ExcelSheet& sheet, const std::vector<size_t>& columns) {
+    const ColumnarSheet* data = sheet.getLanguage(language);
+    if(data == nullptr && sheet.languages.size() == 1 && sheet.languages.front() == Language::None)
+        data = &sheet.data.front();
+
+    if(data == nullptr)
+        throw std::runtime_error(fmt::format("Sheet {} is not loaded in {}.", sheet.name, getLanguageCode(language)));
+
+    std::vector<const ExcelColumn*> columnData;
+    for(const auto column : columns) {
+        const auto it = std::find_if(data->columns.begin(), data->columns.end(), [column](const ExcelColumn& c) {
+            return c.index == column;
+        });
+
+        if(it == data->columns.end())
+            throw std::runtime_error(fmt::format("Column {} of {} is not loaded.", column, sheet.name));
+
+        if(it->definition.type != String)
+            throw std::runtime_error(fmt::format("Column {} of {} is not a string.", column, sheet.name));
+
+        columnData.push_back(&*it);
+    }
+
+    ExcelSearchSheet searchSheet;
+    searchSheet.name = sheet.name;
+    searchSheet.columns = columns;
+    searchSheet.textOffsets.push_back(0);
+
+    std::string text;
+    for(size_t row = 0; row < data->size(); row++) {
+        for(const auto column : columnData) {
+            text.clear();
+            SeStringView(column->getString(row)).appendPlainText(text);
+
+            if(text.empty())
+                continue;
+
+            normalize(text);
+
+            const auto entry = static_cast<uint32_t>(searchSheet.rowIds.size());
+
+            searchSheet.rowIds.push_back(data->rowIds[row]);
+            searchSheet.subrowIds.push_back(data->subrowIds[row]);
+            searchSheet.entryColumns.push_back(column->index);
+            searchSheet.text += text;
+            searchSheet.textOffsets.push_back(searchSheet.text.size());
+
+            for(size_t i = 0; i + 3 <= text.size(); i++) {
+                auto& posting = searchSheet.postings[getTrigram(text, i)];
+
+                // the same trigram can show up more than once in a string
+                if(posting.empty() || posting.back() != entry)
+                    posting.push_back(entry);
+            }
+        }
+    }
+
+    for(auto& existing : sheets) {
+        if(existing.name == sheet.name) {
+            existing = std::move(searchSheet);
+            return;
+        }
+    }
+
+    sheets.push_back(std::move(searchSheet));
+}
+
+void ExcelSearchIndex::removeSheet(const std::string_view name) {
+    sheets.erase(std::remove_if(sheets.begin(), sheets.end(), [name](const ExcelSearchSheet& sheet) {
+        return sheet.name == name;
+    }), sheets.end());
+}
+
+const ExcelSearchSheet* ExcelSearchIndex::getSheet(const std::string_view name) const {
+    for(const auto& sheet : sheets) {
+        if(sheet.name == name)
+            return &sheet;
+    }
+
+    return nullptr;
+}
+
+// returns the entries that have every trigram of the query, these still have to be checked
+static std::vector<uint32_t> getCandidates(const ExcelSearchSheet& sheet, const std::string_view query) {
+    std::vector<uint32_t> trigrams;
+    for(size_t i = 0; i + 3 <= query.size(); i++)
+        trigrams.push_back(getTrigram(query, i));
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    std::vector<const std::vector<uint32_t>*> postings;
+    for(const auto trigram : trigrams) {
+        const auto it = sheet.postings.find(trigram);
+        if(it == sheet.postings.end())
+            return {};
+
+        postings.push_back(&it->second);
+    }
+
+    // intersecting from the rarest trigram keeps the candidate list as small as possible
+    std::sort(postings.begin(), postings.end(), [](const auto a, const auto b) {
+        return a->size() < b->size();
+    });
+
+    std::vector<uint32_t> candidates = *postings.front();
+    std::vector<uint32_t> intersection;
+    for(size_t i = 1; i < postings.size() && !candidates.empty(); i++) {
+        intersection.clear();
+        std::set_intersection(candidates.begin(), candidates.end(), postings[i]->begin(), postings[i]->end(),
+                              std::back_inserter(intersection));
+        candidates.swap(intersection);
+    }
+
+    return candidates;
+}
+
+std::vector<ExcelSearchResult> ExcelSearchIndex::search(const std::string_view query, const size_t limit) const {
+    std::vector<ExcelSearchResult> results;
+
+    std::string normalizedQuery(query);
+    normalize(normalizedQuery);
+
+    if(normalizedQuery.empty())
+        return results;
+
+    for(const auto& sheet : sheets) {
+        const auto addIfMatches = [&](const uint32_t entry) {
+            if(sheet.getText(entry).find(normalizedQuery) == std::string_view::npos)
+                return;
+
+            results.push_back({sheet.name, sheet.rowIds[entry], sheet.subrowIds[entry], sheet.entryColumns[entry]});
+        };
+
+        if(normalizedQuery.size() < 3) {
+            // too short to have a trigram, so every entry is a candidate
+            for(uint32_t entry = 0; entry < sheet.rowIds.size(); entry++) {
+                addIfMatches(entry);
+
+                if(limit != 0 && results.size() >= limit)
+                    return results;
+            }
+        } else {
+            for(const auto entry : getCandidates(sheet, normalizedQuery)) {
+                addIfMatches(entry);
+
+                if(limit != 0 && results.size() >= limit)
+                    return results;
+            }
+        }
+    }
+
+    return results;
+}
+
+static void writeString(MemoryBuffer& buffer, const std::string_view string) {
+    buffer.write(static_cast<uint32_t>(string.size()));
+    buffer.write_bytes(string.data(), string.size());
+}
+
+template<typename T>
+static void writeArray(MemoryBuffer& buffer, const std::vector<T>& array) {
+    buffer.write(static_cast<uint32_t>(array.size()));
+    buffer.write_bytes(array.data(), array.size() * sizeof(T));
+}
+
+// the readers below return false instead of throwing, a corrupt index is just rebuilt
+template<typename T>
+static bool readValue(MemorySpan& span, T& value) {
+    if(span.current_position() + sizeof(T) > span.size())
+        return false;
+
+    span.read(&value);
+
+    return true;
+}
+
+static size_t getRemainingSize(const MemorySpan& span) {
+    return span.size() - span.current_position();
+}
+
+static bool readString(MemorySpan& span, std::string& string) {
+    uint32_t length = 0;
+    if(!readValue(span, length) || length > getRemainingSize(span))
+        return false;
+
+    string.assign(reinterpret_cast<const char*>(span.raw_data() + span.current_position()), length);
+    span.seek(length, Seek::Current);
+
+    return true;
+}
+
+template<typename T>
+static bool readArray(MemorySpan& span, std::vector<T>& array) {
+    uint32_t count = 0;
+    if(!readValue(span, count) || count > getRemainingSize(span) / sizeof(T))
+        return false;
+
+    array.resize(count);
+    if(count != 0)
+        memcpy(array.data(), span.raw_data() + span.current_position(), count * sizeof(T));
+    span.seek(count * sizeof(T), Seek::Current);
+
+    return true;
+}
+
+void writeExcelSearchIndex(const ExcelSearchIndex& index, const std::string_view path, const std::string_view version) {
+    MemoryBuffer buffer;
+
+    buffer.write(searchMagic);
+    buffer.write(searchFormatVersion);
+    writeString(buffer, version);
+
+    buffer.write(static_cast<uint16_t>(index.language));
+    buffer.write(static_cast<uint32_t>(index.sheets.size()));
+
+    for(const auto& sheet : index.sheets) {
+        writeString(buffer, sheet.name);
+
+        std::vector<uint32_t> columns(sheet.columns.begin(), sheet.columns.end());
+        writeArray(buffer, columns);
+
+        writeArray(buffer, sheet.rowIds);
+        writeArray(buffer, sheet.subrowIds);
+        writeArray(buffer, sheet.entryColumns);
+        writeArray(buffer, sheet.textOffsets);
+        writeString(buffer, sheet.text);
+
+        buffer.write(static_cast<uint32_t>(sheet.postings.size()));
+        for(const auto& [trigram, entries] : sheet.postings) {
+            buffer.write(trigram);
+            writeArray(buffer, entries);
+        }
+    }
+
+    write_buffer_to_file(buffer, path);
+}
+
+std::optional<ExcelSearchIndex> readExcelSearchIndex(const std::string_view path, const std::string_view version) {
+    if(!std::filesystem::exists(path))
+        return {};
+
+    const MemoryBuffer buffer = read_file_to_buffer(path);
+    MemorySpan span(buffer);
+
+    uint32_t magic = 0, formatVersion = 0;
+    if(!readValue(span, magic) || !readValue(span, formatVersion))
+        return {};
+
+    if(magic != searchMagic || formatVersion != searchFormatVersion)
+        return {};
+
+    std::string indexVersion;
+    if(!readString(span, indexVersion) || indexVersion != version)
+        return {};
+
+    ExcelSearchIndex index;
+
+    uint16_t language = 0;
+    if(!readValue(span, language))
+        return {};
+
+    index.language = static_cast<Language>(language);
+
+    // every sheet takes at least a name, five arrays, its text and a posting count, which bounds how many can fit
+    constexpr size_t minSheetSize = 8 * sizeof(uint32_t);
+
+    uint32_t sheetCount = 0;
+    if(!readValue(span, sheetCount) || sheetCount > getRemainingSize(span) / minSheetSize)
+        return {};
+
+    index.sheets.resize(sheetCount);
+    for(auto& sheet : index.sheets) {
+        std::vector<uint32_t> columns;
+        if(!readString(span, sheet.name) || !readArray(span, columns) || !readArray(span, sheet.rowIds) ||
+           !readArray(span, sheet.subrowIds) || !readArray(span, sheet.entryColumns) ||
+           !readArray(span, sheet.textOffsets) || !readString(span, sheet.text))
+            return {};
+
+        sheet.columns.assign(columns.begin(), columns.end());
+
+        if(sheet.subrowIds.size() != sheet.rowIds.size() || sheet.entryColumns.size() != sheet.rowIds.size() ||
+           sheet.textOffsets.size() != sheet.rowIds.size() + 1)
+            return {};
+
+        // entries are sliced out of the text by neighbouring offsets
+        if(!std::is_sorted(sheet.textOffsets.begin(), sheet.textOffsets.end()) ||
+           sheet.textOffsets.back() > sheet.text.size())
+            return {};
+
+        // every posting takes at least a trigram and an entry count
+        constexpr size_t minPostingSize = 2 * sizeof(uint32_t);
+
+        uint32_t postingCount = 0;
+        if(!readValue(span, postingCount) || postingCount > getRemainingSize(span) / minPostingSize)
+            return {};
+
+        sheet.postings.reserve(postingCount);
+
+        for(uint32_t i = 0; i < postingCount; i++) {
+            uint32_t trigram = 0;
+            if(!readValue(span, trigram))
+                return {};
+
+            auto& entries = sheet.postings[trigram];
+            if(!readArray(span, entries))
+                return {};
+
+            // candidates are found by intersecting sorted posting lists
+            if(!std::is_sorted(entries.begin(), entries.end()) ||
+               (!entries.empty() && entries.back() >= sheet.rowIds.size()))
+                return {};
+        }
+    }
+
+    return index;
+}
@@ -0,0 +1,144 @@
+#include "excelstringpool.h"
+
+#include <stdexcept>
+
+#include "columnarsheet.h"
+
+constexpr ExcelStringRef emptySlot = UINT32_MAX;
+
+ExcelStringPool::ExcelStringPool() {
+    table.assign(64, emptySlot);
+
+    // the empty string is at the very start, so it's id 0
+    store({});
+}
+
+ExcelStringRef ExcelStringPool::intern(const std::string_view string) {
+    if(string.empty())
+        return 0;
+
+    std::lock_guard lock(mutex);
+
+    const size_t mask = table.size() - 1;
+
+    size_t slot = std::hash<std::string_view>{}(string) & mask;
+    for(; table[slot] != emptySlot; slot = (slot + 1) & mask) {
+        if(get(table[slot]) == string)
+            return table[slot];
+    }
+
+    const ExcelStringRef ref = store(string);
+    table[slot] = ref;
+    stringCount++;
+
+    // keep the table at most half full, so probe sequences stay short
+    if(stringCount * 2 > table.size())
+        grow();
+
+    return ref;
+}
+
+ExcelStringRef ExcelStringPool::store(const std::string_view string) {
+    const size_t size = sizeof(uint32_t) + string.size();
+
+    uint64_t position = end;
+    uint64_t next = end + size;
+
+    // strings never cross chunks, so they're started on a new one if they don't fit in what's left
+    const size_t offset = end & offsetMask;
+    if(offset == 0 || offset + size > chunkSize) {
+        position = offset == 0 ? end : (end | offsetMask) + 1;
+
+        // strings bigger than a chunk get a buffer of their own, which takes up the space of several chunks
+        const size_t chunkCount = (size + chunkSize - 1) / chunkSize;
+        const size_t bufferSize = chunkCount == 1 ? chunkSize : size;
+
+        next = chunkCount == 1 ? position + size : position + chunkCount * chunkSize;
+        if(position + chunkCount * chunkSize > uint64_t(1) << 32)
+            throw std::runtime_error("Excel string pool is full.");
+
+        auto& page = pages[position >> pageShift];
+        if(page == nullptr)
+            page = std::make_unique<ChunkPage>();
+
+        page->chunks[(position >> chunkShift) & chunkMask] = std::make_unique<char[]>(bufferSize);
+        allocatedSize += bufferSize;
+    }
+
+    const auto ref = static_cast<ExcelStringRef>(position);
+
+    char* data = pages[ref >> pageShift]->chunks[(ref >> chunkShift) & chunkMask].get() + (ref & offsetMask);
+
+    const auto length = static_cast<uint32_t>(string.size());
+    memcpy(data, &length, sizeof(uint32_t));
+    if(!string.empty())
+        memcpy(data + sizeof(uint32_t), string.data(), string.size());
+
+    end = next;
+
+    return ref;
+}
+
+void ExcelStringPool::grow() {
+    std::vector<ExcelStringRef> oldTable(table.size() * 2, emptySlot);
+    oldTable.swap(table);
+
+    const size_t mask = table.size() - 1;
+
+    for(const auto ref : oldTable) {
+        if(ref == emptySlot)
+            continue;
+
+        size_t slot = std::hash<std::string_view>{}(get(ref)) & mask;
+        while(table[slot] != emptySlot)
+            slot = (slot + 1) & mask;
+
+        table[slot] = ref;
+    }
+}
+
+size_t ExcelStringPool::size() const {
+    std::lock_guard lock(mutex);
+
+    // the empty string counts too
+    return stringCount + 1;
+}
+
+size_t ExcelStringPool::memoryUsage() const {
+    std::lock_guard lock(mutex);
+
+    size_t usage = sizeof(ExcelStringPool);
+    usage += allocatedSize;
+    usage += table.capacity() * sizeof(ExcelStringRef);
+
+    for(const auto& page : pages) {
+        if(page != nullptr)
+            usage += sizeof(ChunkPage);
+    }
+
+    return usage;
+}
+
+std::shared_ptr<ExcelStringPool> internStrings(ExcelSheet& sheet, std::shared_ptr<ExcelStringPool> pool) {
+    if(pool == nullptr)
+        pool = std::make_shared<ExcelStringPool>();
+
+    for(auto& data : sheet.data) {
+        for(auto& column : data.columns) {
+            if(column.definition.type != String || column.stringPool != nullptr)
+                continue;
+
+            column.stringRefs.resize(data.size());
+            for(size_t row = 0; row < data.size(); row++)
+                column.stringRefs[row] = pool->intern(column.getString(row));
+
+            column.stringPool = pool;
+
+            // swapping actually releases the memory, unlike clear()
+            std::vector<uint32_t>().swap(column.stringOffsets);
+            std::string().swap(column.stringArena);
+        }
+    }
+
+    return pool;
+}
@@ -1,6 +1,7 @@
 #include "exdparser.h"
 
 #include <cstdio>
+#include <cstddef>
 #include <stdexcept>
 #include <algorithm>
 #include <fmt/format.h>
@@ -21,28 +22,45 @@ struct ExcelDataOffset {
     uint32_t offset;
 };
 
-struct ExcelDataRowHeader {
-    uint32_t dataSize;
-    uint16_t rowCount;
-};
-
-template<typename T>
-T readDataRaw(MemorySpan& span, int offset) {
-    span.seek(offset, Seek::Set);
-
-    T value;
-    span.read(&value);
-    endianSwap(&value);
-
-    return value;
+// the row header is 6 bytes on disk, don't read this struct directly because of padding
+constexpr size_t rowHeaderSize = 6;
+
+// subrows are prefixed with their 2-byte subrow id
+constexpr size_t subrowHeaderSize = 2;
+
+// taken from https://xiv.dev/game-data/file-formats/excel
+constexpr uint8_t subrowVariant = 2;
+
+// a row id span wider than this many ids per row is treated as corrupt, real pages are close to contiguous
+constexpr size_t maxRowIdSpread = 64;
+
+// the dense row table is always allowed to cover this many row ids, regardless of how sparse the page is
+constexpr size_t minRowIdSpan = 65536;
+
+static size_t getCellWidth(const ExcelColumnDataType type) {
+    switch(type) {
+        case String:
+        case Int32:
+        case UInt32:
+        case Float32:
+            return 4;
+        case Int16:
+        case UInt16:
+            return 2;
+        case Int64:
+        case UInt64:
+            return 8;
+        default:
+            return 1;
+    }
 }
 
 template<typename T>
-std::string readData(MemorySpan& span, int offset) {
-    return std::to_string(readDataRaw<T>(span, offset));
+std::string readData(const uint8_t* data) {
+    return std::to_string(readBigEndian<T>(data));
 }
 
-std::string getEXDFilename(EXH& exh, std::string_view name, std::string_view lang, ExcelDataPagination& page) {
+std::string getEXDFilename(const EXH& exh, std::string_view name, std::string_view lang, const ExcelDataPagination& page) {
     if(lang.empty()) {
         return fmt::format("{}_{}.exd", name, page.startId);
     } else {
@@ -50,145 +68,284 @@ std::string getEXDFilename(EXH& exh, std::string_view name, std::string_view lan
     }
 }
 
-EXD readEXD(EXH& exh, MemorySpan data, ExcelDataPagination& page) {
-    EXD exd;
+EXDPage::EXDPage(const EXH& exh, MemoryBuffer data) {
+    buffer = std::make_shared<const MemoryBuffer>(std::move(data));
+    this->data = buffer->data.data();
+    size = buffer->data.size();
+
+    columns = exh.columnDefinitions;
+    dataOffset = exh.header.dataOffset;
+    hasSubrows = exh.header.variant == subrowVariant;
+
+    buildRowTable();
+}
 
-    ExcelDataHeader header;
-    data.read(&header);
+EXDPage::EXDPage(const EXH& exh, const uint8_t* data, const size_t size) : data(data), size(size) {
+    columns = exh.columnDefinitions;
+    dataOffset = exh.header.dataOffset;
+    hasSubrows = exh.header.variant == subrowVariant;
 
-    endianSwap(&header.indexSize);
+    buildRowTable();
+}
+
+void EXDPage::buildRowTable() {
+    if(size < sizeof(ExcelDataHeader))
+        throw std::runtime_error("EXD page is too small.");
+
+    // every cell has to fit in the fixed-size part of the row, so decoding a validated row never reads past it
+    for(const auto& column : columns) {
+        if(column.offset + getCellWidth(column.type) > dataOffset)
+            throw std::runtime_error("EXD column is outside of the row.");
+    }
+
+    const auto indexSize = readBigEndian<uint32_t>(data + offsetof(ExcelDataHeader, indexSize));
+    const size_t offsetCount = indexSize / sizeof(ExcelDataOffset);
 
-    std::vector<ExcelDataOffset> dataOffsets;
-    data.read_structures(&dataOffsets, header.indexSize / sizeof(ExcelDataOffset));
+    if(sizeof(ExcelDataHeader) + offsetCount * sizeof(ExcelDataOffset) > size)
+        throw std::runtime_error("EXD offset table is out of bounds.");
 
-    for(auto& offset : dataOffsets) {
-        endianSwap(&offset.offset);
-        endianSwap(&offset.rowId);
+    rowIds.resize(offsetCount);
+
+    uint32_t lastRowId = 0;
+    for(size_t i = 0; i < offsetCount; i++) {
+        rowIds[i] = readBigEndian<uint32_t>(data + sizeof(ExcelDataHeader) + i * sizeof(ExcelDataOffset));
+
+        if(i == 0 || rowIds[i] < firstRowId)
+            firstRowId = rowIds[i];
+        lastRowId = std::max(lastRowId, rowIds[i]);
     }
 
-    for(int i = 0; i < exh.header.rowCount; i++) {
-        for(auto& offset : dataOffsets) {
-            if (offset.rowId == i) {
-                data.seek(offset.offset, Seek::Set);
-
-                ExcelDataRowHeader rowHeader;
-                data.read(&rowHeader);
-
-                endianSwap(&rowHeader.dataSize);
-                endianSwap(&rowHeader.rowCount);
-
-                const int headerOffset = offset.offset + 6;
-
-                const auto readRow = [&exd, &exh, &data, rowHeader](int offset) {
-                    Row row;
-
-                    for (auto column: exh.columnDefinitions) {
-                        Column c;
-
-                        switch (column.type) {
-                            case String: {
-                                data.seek(offset + column.offset, Seek::Set);
-
-                                uint32_t stringLength = 0; // this is actually offset?
-                                data.read(&stringLength);
-
-                                endianSwap(&stringLength);
-
-                                data.seek(offset + exh.header.dataOffset + stringLength, Seek::Set);
-
-                                std::string string;
-
-                                uint8_t byte;
-                                data.read(&byte);
-                                while(byte != 0) {
-                                    string.push_back(byte);
-                                    data.read(&byte);
-                                }
-
-                                c.data = string;
-                                c.type = "String";
-                            }
-                                break;
-                            case Int8:
-                                c.data = readData<int8_t>(data, offset + column.offset);
-                                c.type = "Int";
-                                c.uint64Data = readDataRaw<int8_t>(data, offset + column.offset);
-                                break;
-                            case UInt8:
-                                c.data = readData<uint8_t>(data, offset + column.offset);
-                                c.type = "Unsigned Int";
-                                c.uint64Data = readDataRaw<uint8_t>(data, offset + column.offset);
-                                break;
-                            case Int16:
-                                c.data = readData<int16_t>(data, offset + column.offset);
-                                c.type = "Int";
-                                c.uint64Data = readDataRaw<int16_t>(data, offset + column.offset);
-                                break;
-                            case UInt16:
-                                c.data = readData<uint16_t>(data, offset + column.offset);
-                                c.type = "Unsigned Int";
-                                break;
-                            case Int32:
-                                c.data = readData<int32_t>(data, offset + column.offset);
-                                c.type = "Int";
-                                c.uint64Data = readDataRaw<int32_t>(data, offset + column.offset);
-                                break;
-                            case UInt32:
-                                c.data = readData<uint32_t>(data, offset + column.offset);
-                                c.type = "Unsigned Int";
-                                break;
-                            case Float32:
-                                c.data = readData<float>(data, offset + column.offset);
-                                c.type = "Float";
-                                break;
-                            case Int64:
-                                c.data = readData<int64_t>(data, offset + column.offset);
-                                c.type = "Int";
-                                c.uint64Data = readDataRaw<int64_t>(data, offset + column.offset);
-                                break;
-                            case UInt64:
-                                c.data = readData<uint64_t>(data, offset + column.offset);
-                                c.type = "Unsigned Int";
-                                c.uint64Data = readDataRaw<uint64_t>(data, offset + column.offset);
-                                break;
-                            case PackedBool0:
-                            case PackedBool1:
-                            case PackedBool2:
-                            case PackedBool3:
-                            case PackedBool4:
-                            case PackedBool5:
-                            case PackedBool6:
-                            case PackedBool7: {
-                                int shift = (int) column.type - (int) PackedBool0;
-                                int bit = 1 << shift;
-                                int32_t boolData = readDataRaw<int32_t>(data, offset + column.offset);
-                                c.data = std::to_string((boolData & bit) == bit);
-                                c.type = "Boolean";
-                            }
-                                break;
-                            default:
-                                c.data = "undefined";
-                                c.type = "Unknown";
-                                break;
-                        }
-
-                        row.data.push_back(c);
-                    }
-
-                    exd.rows.push_back(row);
-                };
-
-                if (rowHeader.rowCount > 1) {
-                    for (int i = 0; i < rowHeader.rowCount; i++) {
-                        int subrowOffset = headerOffset + (i * exh.header.dataOffset + 2 * (i + 1));
-                        readRow(subrowOffset);
-                    }
-                } else {
-                    readRow(headerOffset);
-                }
-            }
+    if(offsetCount == 0)
+        return;
+
+    // pages cover a contiguous range of row ids, so a dense table gives us O(1) lookups
+    const size_t rowIdSpan = static_cast<size_t>(lastRowId - firstRowId) + 1;
+    if(rowIdSpan > std::max(offsetCount * maxRowIdSpread, minRowIdSpan))
+        throw std::runtime_error("EXD row ids are too sparse.");
+
+    rowOffsets.resize(rowIdSpan);
+
+    const size_t subrowSize = dataOffset + subrowHeaderSize;
+
+    for(size_t i = 0; i < offsetCount; i++) {
+        const uint8_t* entry = data + sizeof(ExcelDataHeader) + i * sizeof(ExcelDataOffset);
+        const size_t offset = readBigEndian<uint32_t>(entry + offsetof(ExcelDataOffset, offset));
+
+        if(offset + rowHeaderSize > size)
+            throw std::runtime_error("EXD row offset is out of bounds.");
+
+        // check the fixed-size data of every subrow once here, so reads from getRowData() don't have to
+        size_t rowSize = dataOffset;
+        if(hasSubrows)
+            rowSize = readBigEndian<uint16_t>(data + offset + sizeof(uint32_t)) * subrowSize;
+
+        if(offset + rowHeaderSize + rowSize > size)
+            throw std::runtime_error("EXD row data is out of bounds.");
+
+        rowOffsets[rowIds[i] - firstRowId] = offset;
+    }
+
+    std::sort(rowIds.begin(), rowIds.end());
+}
+
+bool EXDPage::hasRow(const uint32_t rowId) const {
+    if(rowId < firstRowId || rowId - firstRowId >= rowOffsets.size())
+        return false;
+
+    return rowOffsets[rowId - firstRowId] != 0;
+}
+
+uint16_t EXDPage::getSubrowCount(const uint32_t rowId) const {
+    if(!hasRow(rowId))
+        return 0;
+
+    if(!hasSubrows)
+        return 1;
+
+    return readBigEndian<uint16_t>(data + rowOffsets[rowId - firstRowId] + sizeof(uint32_t));
+}
+
+const uint8_t* EXDPage::getRowData(const uint32_t rowId, const uint16_t subrow) const {
+    if(!hasRow(rowId))
+        return nullptr;
+
+    const size_t headerOffset = rowOffsets[rowId - firstRowId] + rowHeaderSize;
+
+    if(!hasSubrows)
+        return subrow == 0 ? data + headerOffset : nullptr;
+
+    if(subrow >= getSubrowCount(rowId))
+        return nullptr;
+
+    return data + headerOffset + subrow * (dataOffset + subrowHeaderSize) + subrowHeaderSize;
+}
+
+Row EXDPage::readRow(const uint32_t rowId, const uint16_t subrow) const {
+    const uint8_t* row = getRowData(rowId, subrow);
+    if(row == nullptr)
+        throw std::runtime_error(fmt::format("Row {}:{} is not in this page.", rowId, subrow));
+
+    Row decodedRow;
+    decodedRow.data.reserve(columns.size());
+
+    for(const auto& column : columns)
+        decodedRow.data.push_back(decodeColumn(row, column));
+
+    return decodedRow;
+}
+
+Row EXDPage::readRow(const uint32_t rowId, const std::vector<size_t>& columns, const uint16_t subrow) const {
+    const uint8_t* row = getRowData(rowId, subrow);
+    if(row == nullptr)
+        throw std::runtime_error(fmt::format("Row {}:{} is not in this page.", rowId, subrow));
+
+    Row decodedRow;
+    decodedRow.data.reserve(columns.size());
+
+    for(const auto column : columns)
+        decodedRow.data.push_back(decodeColumn(row, this->columns.at(column)));
+
+    return decodedRow;
+}
+
+Column EXDPage::readColumn(const uint32_t rowId, const size_t column, const uint16_t subrow) const {
+    const uint8_t* row = getRowData(rowId, subrow);
+    if(row == nullptr)
+        throw std::runtime_error(fmt::format("Row {}:{} is not in this page.", rowId, subrow));
+
+    return decodeColumn(row, columns.at(column));
+}
+
+std::string_view EXDPage::readString(const uint32_t rowId, const size_t column, const uint16_t subrow) const {
+    const uint8_t* row = getRowData(rowId, subrow);
+    if(row == nullptr)
+        throw std::runtime_error(fmt::format("Row {}:{} is not in this page.", rowId, subrow));
+
+    if(columns.at(column).type != String)
+        throw std::runtime_error("Column is not a string.");
+
+    return decodeString(row, columns[column]);
+}
+
+std::string_view EXDPage::decodeString(const uint8_t* row, const ExcelColumnDefinition& column) const {
+    const auto stringOffset = readBigEndian<uint32_t>(row + column.offset);
+
+    const size_t stringStart = static_cast<size_t>(row - data) + dataOffset;
+    if(stringOffset >= size - std::min(stringStart, size))
+        return {};
+
+    const uint8_t* begin = data + stringStart + stringOffset;
+    const uint8_t* end = data + size;
+
+    const uint8_t* terminator = findByte(begin, end, 0);
+
+    return {reinterpret_cast<const char*>(begin), static_cast<size_t>(terminator - begin)};
+}
+
+SeStringView EXDPage::getSeString(const uint32_t rowId, const size_t column, const uint16_t subrow) const {
+    return SeStringView(readString(rowId, column, subrow));
+}
+
+Column EXDPage::decodeColumn(const uint8_t* row, const ExcelColumnDefinition& column) const {
+    Column c;
+
+    const uint8_t* cell = row + column.offset;
+
+    switch (column.type) {
+        case String:
+            c.data = decodeString(row, column);
+            c.type = "String";
+            break;
+        case Bool:
+            c.uint64Data = readBigEndian<uint8_t>(cell) != 0;
+            c.data = std::to_string(c.uint64Data);
+            c.type = "Boolean";
+            break;
+        case Int8:
+            c.uint64Data = readBigEndian<int8_t>(cell);
+            c.data = std::to_string(c.uint64Data);
+            c.type = "Int";
+            break;
+        case UInt8:
+            c.uint64Data = readBigEndian<uint8_t>(cell);
+            c.data = std::to_string(c.uint64Data);
+            c.type = "Unsigned Int";
+            break;
+        case Int16:
+            c.uint64Data = readBigEndian<int16_t>(cell);
+            c.data = std::to_string(c.uint64Data);
+            c.type = "Int";
+            break;
+        case UInt16:
+            c.uint64Data = readBigEndian<uint16_t>(cell);
+            c.data = std::to_string(c.uint64Data);
+            c.type = "Unsigned Int";
+            break;
+        case Int32:
+            c.uint64Data = readBigEndian<int32_t>(cell);
+            c.data = std::to_string(c.uint64Data);
+            c.type = "Int";
+            break;
+        case UInt32:
+            c.uint64Data = readBigEndian<uint32_t>(cell);
+            c.data = std::to_string(c.uint64Data);
+            c.type = "Unsigned Int";
+            break;
+        case Float32:
+            c.data = readData<float>(cell);
+            c.type = "Float";
+            break;
+        case Int64:
+            c.uint64Data = readBigEndian<int64_t>(cell);
+            c.data = std::to_string(c.uint64Data);
+            c.type = "Int";
+            break;
+        case UInt64: {
+            const auto value = readBigEndian<uint64_t>(cell);
+            c.data = std::to_string(value);
+            c.type = "Unsigned Int";
+            c.uint64Data = static_cast<int64_t>(value);
+        }
+            break;
+        case PackedBool0:
+        case PackedBool1:
+        case PackedBool2:
+        case PackedBool3:
+        case PackedBool4:
+        case PackedBool5:
+        case PackedBool6:
+        case PackedBool7: {
+            int shift = (int) column.type - (int) PackedBool0;
+            int bit = 1 << shift;
+            uint8_t boolData = readBigEndian<uint8_t>(cell);
+            c.uint64Data = (boolData & bit) == bit;
+            c.data = std::to_string(c.uint64Data);
+            c.type = "Boolean";
+        }
+            break;
+        default:
+            c.data = "undefined";
+            c.type = "Unknown";
+            break;
+    }
+
+    return c;
+}
+
+EXD readEXD(EXH& exh, MemorySpan data, ExcelDataPagination& page, const std::vector<size_t>& columns) {
+    EXD exd;
+
+    const EXDPage exdPage(exh, data.raw_data(), data.size());
+
+    for(const auto rowId : exdPage.getRowIds()) {
+        const uint16_t subrowCount = exdPage.getSubrowCount(rowId);
+        for(uint16_t i = 0; i < subrowCount; i++) {
+            if(columns.empty())
+                exd.rows.push_back(exdPage.readRow(rowId, i));
+            else
+                exd.rows.push_back(exdPage.readRow(rowId, columns, i));
         }
     }
 
     return exd;
-}
\ No newline at end of file
+}
@@ -35,4 +35,19 @@ EXH readEXH(MemorySpan data) {
     }
 
     return exh;
-}
\ No newline at end of file
+}
+
+std::optional<size_t> findColumn(const EXH& exh, const uint16_t offset, const ExcelColumnDataType type) {
+    for(size_t i = 0; i < exh.columnDefinitions.size(); i++) {
+        if(exh.columnDefinitions[i].offset == offset && exh.columnDefinitions[i].type == type)
+            return i;
+    }
+
+    return {};
+}
+
+bool isLocalized(const EXH& exh) {
+    return std::any_of(exh.language.begin(), exh.language.end(), [](const Language language) {
+        return language != Language::None;
+    });
+}
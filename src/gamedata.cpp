@@ -4,17 +4,20 @@
 #include "compression.h"
 #include "string_utils.h"
 #include "exlparser.h"
+#include "exdparser.h"
+#include "parallel.h"
 
 #include <string>
 #include <algorithm>
 #include <unordered_map>
+#include <unordered_set>
 #include <array>
 #include <fmt/printf.h>
 #include <filesystem>
 
 // TODO: should be enum?
 // taken from https://xiv.dev/data-files/sqpack#categories
-std::unordered_map<std::string_view, int> categoryToID = {
+const std::unordered_map<std::string_view, int> categoryToID = {
         {"common", 0},
         {"bgcommon", 1},
         {"bg", 2},
@@ -32,6 +35,15 @@ std::unordered_map<std::string_view, int> categoryToID = {
         {"debug", 14},
 };
 
+// extractFile() is called from several threads at once, so this must never insert into categoryToID
+static int getCategoryID(const std::string_view category) {
+    const auto it = categoryToID.find(category);
+    if(it == categoryToID.end())
+        throw std::runtime_error(fmt::format("Unknown category: {}", category));
+
+    return it->second;
+}
+
 GameData::GameData(const std::string_view dataDirectory) {
     this->dataDirectory = dataDirectory;
 
@@ -95,11 +107,11 @@ std::tuple<Repository, std::string> GameData::calculateRepositoryCategory(std::s
     return {getBaseRepository(), tokens[0]};
 }
 
-std::optional<MemoryBuffer> GameData::extractFile(const std::string_view data_file_path) {
+std::optional<MemoryBuffer> GameData::extractFile(const std::string_view data_file_path, const uint8_t lodMask) {
     const uint64_t hash = calculateHash(data_file_path);
     auto [repository, category] = calculateRepositoryCategory(data_file_path);
 
-    auto [index_filename, index2_filename] = repository.get_index_filenames(categoryToID[category]);
+    auto [index_filename, index2_filename] = repository.get_index_filenames(getCategoryID(category));
     auto index_path = fmt::format("{data_directory}/{repository}/{filename}",
                                   fmt::arg("data_directory", dataDirectory),
                                   fmt::arg("repository", repository.name),
@@ -113,7 +125,7 @@ std::optional<MemoryBuffer> GameData::extractFile(const std::string_view data_fi
 
     for(const auto entry : index_file.entries) {
         if(entry.hash == hash) {
-            auto data_filename = repository.get_dat_filename(categoryToID[category], entry.dataFileId);
+            auto data_filename = repository.get_dat_filename(getCategoryID(category), entry.dataFileId);
 
             FILE* file = fopen((dataDirectory + "/" + repository.name + "/" + data_filename).c_str(), "rb");
             if(file == nullptr) {
@@ -225,11 +237,12 @@ std::optional<MemoryBuffer> GameData::extractFile(const std::string_view data_fi
                 uint32_t stackSize = 0;
                 uint32_t runtimeSize = 0;
 
-                std::array<uint32_t, 3> vertexDataOffsets;
-                std::array<uint32_t, 3> indexDataOffsets;
+                // LODs that aren't extracted keep an offset and size of 0
+                std::array<uint32_t, 3> vertexDataOffsets = {};
+                std::array<uint32_t, 3> indexDataOffsets = {};
 
-                std::array<uint32_t, 3> vertexDataSizes;
-                std::array<uint32_t, 3> indexDataSizes;
+                std::array<uint32_t, 3> vertexDataSizes = {};
+                std::array<uint32_t, 3> indexDataSizes = {};
 
                 // data.append 0x44
                 buffer.seek(0x44, Seek::Set);
@@ -266,6 +279,13 @@ std::optional<MemoryBuffer> GameData::extractFile(const std::string_view data_fi
 
                 // process all 3 lods
                 for(int i = 0; i < 3; i++) {
+                    // the blocks of LODs that aren't needed are never read or inflated, only skipped over
+                    if((lodMask & (1 << i)) == 0) {
+                        currentBlock += modelInfo.vertexBlockBufferBlockNum[i];
+                        currentBlock += modelInfo.indexBufferBlockNum[i];
+                        continue;
+                    }
+
                     if(modelInfo.vertexBlockBufferBlockNum[i] != 0) {
                         int currentVertexOffset = buffer.current_position();
                         if(i == 0 || currentVertexOffset != vertexDataOffsets[i - 1])
@@ -296,6 +316,8 @@ std::optional<MemoryBuffer> GameData::extractFile(const std::string_view data_fi
                         else
                             indexDataOffsets[i] = 0;
 
+                        fseek(file, baseOffset + modelInfo.indexBufferOffset[i], SEEK_SET);
+
                         for(int j = 0; j < modelInfo.indexBufferBlockNum[i]; j++) {
                             size_t lastPos = ftell(file);
 
@@ -351,11 +373,19 @@ std::optional<MemoryBuffer> GameData::extractFile(const std::string_view data_fi
     return std::nullopt;
 }
 
+std::optional<Model> GameData::extractModel(const std::string_view data_file_path, const MDLParseOptions& options) {
+    const auto data = extractFile(data_file_path, options.lodMask);
+    if(!data)
+        return {};
+
+    return parseMDL(*data, options);
+}
+
 bool GameData::exists(std::string_view data_file_path) {
     const uint64_t hash = calculateHash(data_file_path);
     auto [repository, category] = calculateRepositoryCategory(data_file_path);
 
-    auto [index_filename, index2_filename] = repository.get_index_filenames(categoryToID[category]);
+    auto [index_filename, index2_filename] = repository.get_index_filenames(getCategoryID(category));
     auto index_path = fmt::format("{data_directory}/{repository}/{filename}",
                                   fmt::arg("data_directory", dataDirectory),
                                   fmt::arg("repository", repository.name),
@@ -376,6 +406,47 @@ bool GameData::exists(std::string_view data_file_path) {
     return false;
 }
 
+std::vector<bool> GameData::exists(const std::vector<std::string>& data_file_paths) {
+    // group the paths by the index file they would be in
+    std::unordered_map<std::string, std::vector<size_t>> pathsByIndex;
+    std::unordered_map<std::string, std::string> index2Paths;
+
+    for(size_t i = 0; i < data_file_paths.size(); i++) {
+        auto [repository, category] = calculateRepositoryCategory(data_file_paths[i]);
+
+        auto [index_filename, index2_filename] = repository.get_index_filenames(getCategoryID(category));
+        auto index_path = fmt::format("{data_directory}/{repository}/{filename}",
+                                      fmt::arg("data_directory", dataDirectory),
+                                      fmt::arg("repository", repository.name),
+                                      fmt::arg("filename", index_filename));
+
+        if(!index2Paths.count(index_path)) {
+            index2Paths[index_path] = fmt::format("{data_directory}/{repository}/{filename}",
+                                                  fmt::arg("data_directory", dataDirectory),
+                                                  fmt::arg("repository", repository.name),
+                                                  fmt::arg("filename", index2_filename));
+        }
+
+        pathsByIndex[index_path].push_back(i);
+    }
+
+    std::vector<bool> found(data_file_paths.size(), false);
+
+    for(const auto& [index_path, paths] : pathsByIndex) {
+        const auto index_file = read_index_files(index_path, index2Paths[index_path]);
+
+        std::unordered_set<uint64_t> hashes;
+        hashes.reserve(index_file.entries.size());
+        for(const auto& entry : index_file.entries)
+            hashes.insert(entry.hash);
+
+        for(const size_t i : paths)
+            found[i] = hashes.count(calculateHash(data_file_paths[i])) != 0;
+    }
+
+    return found;
+}
+
 std::optional<EXH> GameData::readExcelSheet(std::string_view name) {
     for(const auto& row : rootEXL.rows) {
         if(row.name == name) {
@@ -397,6 +468,173 @@ std::optional<EXH> GameData::readExcelSheet(std::string_view name) {
     return {};
 }
 
+std::optional<ExcelSheet> GameData::loadSheet(const std::string_view name,
+                                              const std::vector<Language>& languages,
+                                              const std::vector<size_t>& columns) {
+    auto exh = readExcelSheet(name);
+    if(!exh)
+        return {};
+
+    ExcelSheet sheet;
+    sheet.name = name;
+    sheet.exh = *exh;
+
+    if(isLocalized(*exh)) {
+        for(const auto language : languages) {
+            if(std::find(exh->language.begin(), exh->language.end(), language) == exh->language.end())
+                throw std::runtime_error(fmt::format("Sheet {} is not available in {}.", name, getLanguageCode(language)));
+
+            sheet.languages.push_back(language);
+        }
+    } else {
+        sheet.languages.push_back(Language::None);
+    }
+
+    const size_t pageCount = sheet.exh.pages.size();
+
+    // extracting and inflating is the slowest part, so every page in every language is done in parallel first
+    std::vector<EXDPage> pages(sheet.languages.size() * pageCount);
+    parallelFor(pages.size(), [&](const size_t i) {
+        const Language language = sheet.languages[i / pageCount];
+        const auto& page = sheet.exh.pages[i % pageCount];
+
+        const std::string path = "exd/" + getEXDFilename(sheet.exh, toLowercase(std::string(name)), getLanguageCode(language), page);
+
+        auto data = extractFile(path);
+        if(!data)
+            throw std::runtime_error("Failed to extract excel page " + path);
+
+        pages[i] = EXDPage(sheet.exh, std::move(*data));
+    });
+
+    // then the pages of each language are merged in order
+    const auto plan = compileDecodePlan(sheet.exh.columnDefinitions, columns);
+
+    sheet.data.resize(sheet.languages.size());
+    parallelFor(sheet.languages.size(), [&](const size_t i) {
+        for(size_t j = 0; j < pageCount; j++)
+            appendColumnarEXD(sheet.data[i], pages[i * pageCount + j], plan);
+    });
+
+    sheet.buildRowIndex();
+
+    return sheet;
+}
+
+const EXH* GameData::getCachedExcelSheet(const std::string_view name) {
+    std::lock_guard lock(excelSheetCacheMutex);
+
+    const std::string key(name);
+
+    auto it = excelSheetCache.find(key);
+    if(it == excelSheetCache.end()) {
+        auto exh = readExcelSheet(name);
+        if(!exh)
+            return nullptr;
+
+        it = excelSheetCache.emplace(key, std::move(*exh)).first;
+    }
+
+    return &it->second;
+}
+
+std::shared_ptr<const EXDPage> GameData::getPage(const std::string_view sheet, const uint32_t rowId, Language language) {
+    const EXH* exh = getCachedExcelSheet(sheet);
+    if(exh == nullptr)
+        return nullptr;
+
+    // pages are sorted by their starting row id, so the row is in the last page that starts before it
+    auto page = std::upper_bound(exh->pages.begin(), exh->pages.end(), rowId,
+                                 [](const uint32_t id, const ExcelDataPagination& page) {
+        return id < page.startId;
+    });
+
+    if(page == exh->pages.begin())
+        return nullptr;
+
+    --page;
+
+    if(!isLocalized(*exh))
+        language = Language::None;
+
+    const std::string path = "exd/" + getEXDFilename(*exh, toLowercase(std::string(sheet)), getLanguageCode(language), *page);
+
+    if(auto cached = pageCache.get(path))
+        return *cached;
+
+    auto data = extractFile(path);
+    if(!data)
+        return nullptr;
+
+    auto exdPage = std::make_shared<const EXDPage>(*exh, std::move(*data));
+    pageCache.put(path, exdPage);
+
+    return exdPage;
+}
+
+std::optional<Row> GameData::getRow(const std::string_view sheet, const uint32_t rowId, const Language language) {
+    return getSubrow(sheet, rowId, 0, language);
+}
+
+std::optional<Row> GameData::getSubrow(const std::string_view sheet, const uint32_t rowId, const uint16_t subrow, const Language language) {
+    const auto page = getPage(sheet, rowId, language);
+    if(page == nullptr || page->getRowData(rowId, subrow) == nullptr)
+        return {};
+
+    return page->readRow(rowId, subrow);
+}
+
+void GameData::setPageCacheCapacity(const size_t pages) {
+    pageCache.setCapacity(pages);
+}
+
+std::string GameData::getGameVersion() {
+    // the data directory is game/sqpack, and the version file is in game/
+    const auto versionPath = std::filesystem::path(dataDirectory).parent_path() / "ffxivgame.ver";
+    if(!std::filesystem::exists(versionPath))
+        return {};
+
+    const auto versionData = read_file_to_buffer(versionPath.string());
+
+    std::string version(versionData.data.begin(), versionData.data.end());
+    version.erase(std::remove_if(version.begin(), version.end(), [](unsigned char c) {
+        return std::isspace(c);
+    }), version.end());
+
+    return version;
+}
+
+std::optional<MappedExcelSheet> GameData::openCachedSheet(const std::string_view cacheDirectory, const std::string_view name, const Language requestedLanguage) {
+    const std::string version = getGameVersion();
+    if(version.empty())
+        throw std::runtime_error("Could not determine the game version for the excel cache.");
+
+    const EXH* exh = getCachedExcelSheet(name);
+    if(exh == nullptr)
+        return {};
+
+    // unlocalized sheets only have one set of pages, so every language shares the same cache file
+    Language language = requestedLanguage;
+    if(!isLocalized(*exh))
+        language = Language::None;
+    else if(language == Language::None)
+        throw std::runtime_error(fmt::format("Sheet {} is localized, a language has to be given for the cache.", name));
+
+    const std::string path = getExcelCachePath(cacheDirectory, name, language);
+
+    if(auto cached = openExcelCache(path, version))
+        return cached;
+
+    auto sheet = loadSheet(name, {language});
+    if(!sheet)
+        return {};
+
+    std::filesystem::create_directories(cacheDirectory);
+    writeExcelCache(sheet->data.front(), path, version);
+
+    return openExcelCache(path, version);
+}
+
 void GameData::extractSkeleton(Race race) {
     const std::string path = fmt::format("chara/human/c{race:04d}/skeleton/base/b0001/skl_c{race:04d}b0001.sklb",
                                          fmt::arg("race", get_race_id(race)));
@@ -446,7 +684,7 @@ void GameData::extractSkeleton(Race race) {
 IndexFile<IndexHashTableEntry> GameData::getIndexListing(std::string_view folder) {
     auto [repository, category] = calculateRepositoryCategory(fmt::format("{}/{}", folder, "a"));
 
-    auto [indexFilename, index2Filename] = repository.get_index_filenames(categoryToID[category]);
+    auto [indexFilename, index2Filename] = repository.get_index_filenames(getCategoryID(category));
 
     return readIndexFile(dataDirectory + "/" + repository.name + "/" + indexFilename);
 }
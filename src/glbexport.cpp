@@ -0,0 +1,431 @@
+#include "glbexport.h"
+
+#include <cmath>
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+
+#include "parallel.h"
+
+constexpr uint32_t glbMagic = 0x46546C67; // glTF
+constexpr uint32_t glbVersion = 2;
+constexpr uint32_t jsonChunkType = 0x4E4F534A; // JSON
+constexpr uint32_t binaryChunkType = 0x004E4942; // BIN
+
+// glTF component types and buffer view targets
+constexpr int unsignedByteType = 5121;
+constexpr int unsignedShortType = 5123;
+constexpr int floatType = 5126;
+constexpr int arrayBufferTarget = 34962;
+constexpr int elementArrayBufferTarget = 34963;
+
+// the vertex accessors point straight into Vertex structs
+static_assert(sizeof(Vertex) == 52);
+static_assert(offsetof(Vertex, position) == 0 && offsetof(Vertex, uv) == 12 && offsetof(Vertex, normal) == 20);
+static_assert(offsetof(Vertex, boneWeights) == 32 && offsetof(Vertex, boneIds) == 48);
+
+// column major, like glTF
+using Matrix = std::array<float, 16>;
+
+constexpr Matrix identityMatrix = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+
+static Matrix multiply(const Matrix& a, const Matrix& b) {
+    Matrix result = {};
+    for(int column = 0; column < 4; column++) {
+        for(int row = 0; row < 4; row++) {
+            for(int k = 0; k < 4; k++)
+                result[column * 4 + row] += a[k * 4 + row] * b[column * 4 + k];
+        }
+    }
+
+    return result;
+}
+
+static Matrix getBoneTransform(const Bone& bone) {
+    const auto [x, y, z, w] = bone.rotation;
+    const auto& scale = bone.scale;
+    const auto& position = bone.position;
+
+    return {
+        (1 - 2 * (y * y + z * z)) * scale[0], 2 * (x * y + z * w) * scale[0], 2 * (x * z - y * w) * scale[0], 0,
+        2 * (x * y - z * w) * scale[1], (1 - 2 * (x * x + z * z)) * scale[1], 2 * (y * z + x * w) * scale[1], 0,
+        2 * (x * z + y * w) * scale[2], 2 * (y * z - x * w) * scale[2], (1 - 2 * (x * x + y * y)) * scale[2], 0,
+        position[0], position[1], position[2], 1
+    };
+}
+
+// bone transforms never have a projection, so only the upper 3x3 has to be inverted
+static Matrix invertAffine(const Matrix& m) {
+    const float a = m[0], b = m[4], c = m[8];
+    const float d = m[1], e = m[5], f = m[9];
+    const float g = m[2], h = m[6], i = m[10];
+
+    const float determinant = a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+    if(std::fabs(determinant) < 1e-12f)
+        return identityMatrix;
+
+    const float s = 1.0f / determinant;
+
+    Matrix result = {
+        (e * i - f * h) * s, (f * g - d * i) * s, (d * h - e * g) * s, 0,
+        (c * h - b * i) * s, (a * i - c * g) * s, (b * g - a * h) * s, 0,
+        (b * f - c * e) * s, (c * d - a * f) * s, (a * e - b * d) * s, 0,
+        0, 0, 0, 1
+    };
+
+    for(int row = 0; row < 3; row++)
+        result[12 + row] = -(result[row] * m[12] + result[4 + row] * m[13] + result[8 + row] * m[14]);
+
+    return result;
+}
+
+// JSON has no infinity or NaN
+static std::string formatFloat(const float value) {
+    return fmt::format("{}", std::isfinite(value) ? value : 0.0f);
+}
+
+template<typename T>
+static std::string formatFloats(const T& values) {
+    std::string string = "[";
+    for(size_t i = 0; i < values.size(); i++) {
+        if(i != 0)
+            string += ',';
+
+        string += formatFloat(values[i]);
+    }
+
+    return string + "]";
+}
+
+static std::string escapeString(const std::string_view string) {
+    std::string escaped = "\"";
+    for(const char c : string) {
+        if(c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if(static_cast<unsigned char>(c) < 0x20) {
+            escaped += fmt::format("\\u{:04x}", static_cast<int>(c));
+        } else {
+            escaped += c;
+        }
+    }
+
+    return escaped + "\"";
+}
+
+static std::string joinArray(const std::vector<std::string>& items) {
+    std::string string = "[";
+    for(size_t i = 0; i < items.size(); i++) {
+        if(i != 0)
+            string += ',';
+
+        string += items[i];
+    }
+
+    return string + "]";
+}
+
+/*
+ * Everything that goes into the file, the binary chunk is only a list of pointers into the model until it's written.
+ */
+struct GLBDocument {
+    std::vector<std::string> nodes, meshes, skins, accessors, bufferViews;
+    std::vector<uint32_t> sceneNodes;
+
+    struct Segment {
+        const void* data;
+        size_t size;
+    };
+
+    std::vector<Segment> segments;
+    size_t binaryLength = 0;
+
+    // data that isn't in the model, deque so the segments pointing into it stay valid
+    std::deque<std::vector<Matrix>> ownedMatrices;
+
+    uint32_t addBufferView(const void* data, const size_t size, const uint32_t stride, const int target) {
+        std::string view = fmt::format(R"({{"buffer":0,"byteOffset":{},"byteLength":{})", binaryLength, size);
+        if(stride != 0)
+            view += fmt::format(R"(,"byteStride":{})", stride);
+        if(target != 0)
+            view += fmt::format(R"(,"target":{})", target);
+        view += "}";
+
+        bufferViews.push_back(std::move(view));
+
+        segments.push_back({data, size});
+
+        // every view starts 4 byte aligned
+        binaryLength += (size + 3) & ~size_t(3);
+
+        return static_cast<uint32_t>(bufferViews.size() - 1);
+    }
+
+    uint32_t addAccessor(const uint32_t bufferView, const size_t byteOffset, const int componentType, const size_t count,
+                         const std::string_view type, const std::string_view extra = {}) {
+        accessors.push_back(fmt::format(R"({{"bufferView":{},"byteOffset":{},"componentType":{},"count":{},"type":"{}"{}}})",
+                                        bufferView, byteOffset, componentType, count, type, extra));
+
+        return static_cast<uint32_t>(accessors.size() - 1);
+    }
+};
+
+static std::string getBoundsExtra(const float* positions, const size_t count, const size_t stride) {
+    std::array<float, 3> min = {INFINITY, INFINITY, INFINITY}, max = {-INFINITY, -INFINITY, -INFINITY};
+
+    for(size_t i = 0; i < count; i++) {
+        const float* position = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + i * stride);
+        for(int j = 0; j < 3; j++) {
+            min[j] = std::min(min[j], position[j]);
+            max[j] = std::max(max[j], position[j]);
+        }
+    }
+
+    return fmt::format(R"(,"min":{},"max":{})", formatFloats(min), formatFloats(max));
+}
+
+// adds the bones of the skeleton as nodes, in the same order, and returns their inverse bind matrices
+static std::vector<Matrix> addSkeletonNodes(GLBDocument& document, const Skeleton& skeleton) {
+    const size_t boneCount = skeleton.bones.size();
+
+    std::vector<int> parents(boneCount, -1);
+    std::vector<std::vector<uint32_t>> children(boneCount);
+
+    for(size_t i = 0; i < boneCount; i++) {
+        const int parent = skeleton.bones[i].parentIndex;
+        // skeletons are sorted so parents come first, which the world transforms below rely on
+        if(parent >= 0 && static_cast<size_t>(parent) < i) {
+            parents[i] = parent;
+            children[parent].push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    std::vector<Matrix> worldTransforms(boneCount);
+    std::vector<Matrix> inverseBindMatrices(boneCount);
+
+    for(size_t i = 0; i < boneCount; i++) {
+        const auto& bone = skeleton.bones[i];
+
+        std::string node = fmt::format(R"({{"name":{},"translation":{},"rotation":{},"scale":{})",
+                                       escapeString(bone.name), formatFloats(bone.position),
+                                       formatFloats(bone.rotation), formatFloats(bone.scale));
+
+        if(!children[i].empty())
+            node += fmt::format(R"(,"children":[{}])", fmt::join(children[i], ","));
+
+        document.nodes.push_back(node + "}");
+
+        if(parents[i] == -1)
+            document.sceneNodes.push_back(static_cast<uint32_t>(i));
+
+        const Matrix local = getBoneTransform(bone);
+        worldTransforms[i] = parents[i] == -1 ? local : multiply(worldTransforms[parents[i]], local);
+        inverseBindMatrices[i] = invertAffine(worldTransforms[i]);
+    }
+
+    return inverseBindMatrices;
+}
+
+void writeGLB(const Model& model, std::ostream& stream, const Skeleton* skeleton, const int lod) {
+    if(lod < 0 || static_cast<size_t>(lod) >= model.lods.size())
+        throw std::runtime_error(fmt::format("Model doesn't have LOD {}.", lod));
+
+    GLBDocument document;
+
+    // bone nodes go first, so their node index is the same as their bone index
+    // indexed by node
+    std::vector<Matrix> inverseBindMatrices;
+    std::unordered_map<std::string_view, uint32_t> boneNodes;
+
+    if(skeleton != nullptr) {
+        inverseBindMatrices = addSkeletonNodes(document, *skeleton);
+
+        for(size_t i = 0; i < skeleton->bones.size(); i++)
+            boneNodes.emplace(skeleton->bones[i].name, static_cast<uint32_t>(i));
+    }
+
+    const auto getBoneNode = [&](const std::string& name) {
+        if(const auto it = boneNodes.find(name); it != boneNodes.end())
+            return it->second;
+
+        // the model uses a bone the skeleton doesn't have, which still needs a node to be a joint
+        const auto node = static_cast<uint32_t>(document.nodes.size());
+        document.nodes.push_back(fmt::format(R"({{"name":{}}})", escapeString(name)));
+        document.sceneNodes.push_back(node);
+        boneNodes.emplace(name, node);
+
+        // part nodes come in between, so this isn't always the next index
+        inverseBindMatrices.resize(node + 1, identityMatrix);
+
+        return node;
+    };
+
+    const auto& parts = model.lods[lod].parts;
+
+    for(size_t i = 0; i < parts.size(); i++) {
+        const auto& part = parts[i];
+
+        const bool usesStreams = part.vertices.empty() && !part.streams.positions.empty();
+        const size_t vertexCount = usesStreams ? part.streams.positions.size() / 3 : part.vertices.size();
+
+        // glTF doesn't allow empty accessors
+        if(vertexCount == 0)
+            continue;
+
+        const bool skinned = skeleton != nullptr && !part.boneTable.empty();
+
+        std::string attributes;
+
+        if(usesStreams) {
+            const auto& streams = part.streams;
+
+            const auto addStream = [&](const std::string_view name, const void* data, const size_t size, const int componentType,
+                                       const std::string_view type, const std::string_view extra = {}) {
+                const uint32_t view = document.addBufferView(data, size, 0, arrayBufferTarget);
+                const uint32_t accessor = document.addAccessor(view, 0, componentType, vertexCount, type, extra);
+                attributes += fmt::format(R"({}"{}":{})", attributes.empty() ? "" : ",", name, accessor);
+            };
+
+            addStream("POSITION", streams.positions.data(), vertexCount * sizeof(float) * 3, floatType, "VEC3",
+                      getBoundsExtra(streams.positions.data(), vertexCount, sizeof(float) * 3));
+            addStream("TEXCOORD_0", streams.uvs.data(), vertexCount * sizeof(float) * 2, floatType, "VEC2");
+            addStream("NORMAL", streams.normals.data(), vertexCount * sizeof(float) * 3, floatType, "VEC3");
+
+            if(skinned) {
+                addStream("WEIGHTS_0", streams.boneWeights.data(), vertexCount * sizeof(float) * 4, floatType, "VEC4");
+                addStream("JOINTS_0", streams.boneIds.data(), vertexCount * 4, unsignedByteType, "VEC4");
+            }
+        } else {
+            // one interleaved view over the Vertex structs, each attribute is an accessor at its offset
+            const uint32_t view = document.addBufferView(part.vertices.data(), vertexCount * sizeof(Vertex), sizeof(Vertex), arrayBufferTarget);
+
+            const auto addAttribute = [&](const std::string_view name, const size_t offset, const int componentType,
+                                          const std::string_view type, const std::string_view extra = {}) {
+                const uint32_t accessor = document.addAccessor(view, offset, componentType, vertexCount, type, extra);
+                attributes += fmt::format(R"({}"{}":{})", attributes.empty() ? "" : ",", name, accessor);
+            };
+
+            addAttribute("POSITION", offsetof(Vertex, position), floatType, "VEC3",
+                         getBoundsExtra(part.vertices[0].position.data(), vertexCount, sizeof(Vertex)));
+            addAttribute("TEXCOORD_0", offsetof(Vertex, uv), floatType, "VEC2");
+            addAttribute("NORMAL", offsetof(Vertex, normal), floatType, "VEC3");
+
+            if(skinned) {
+                addAttribute("WEIGHTS_0", offsetof(Vertex, boneWeights), floatType, "VEC4");
+                addAttribute("JOINTS_0", offsetof(Vertex, boneIds), unsignedByteType, "VEC4");
+            }
+        }
+
+        std::string primitive = fmt::format(R"({{"attributes":{{{}}},"mode":4)", attributes);
+        if(!part.indices.empty()) {
+            const uint32_t view = document.addBufferView(part.indices.data(), part.indices.size() * sizeof(uint16_t), 0, elementArrayBufferTarget);
+            primitive += fmt::format(R"(,"indices":{})", document.addAccessor(view, 0, unsignedShortType, part.indices.size(), "SCALAR"));
+        }
+
+        document.meshes.push_back(fmt::format(R"({{"primitives":[{}}}]}})", primitive));
+
+        std::string node = fmt::format(R"({{"name":"Part {}","mesh":{})", i, document.meshes.size() - 1);
+
+        if(skinned) {
+            std::vector<uint32_t> joints;
+            std::vector<Matrix> matrices;
+
+            for(const auto bone : part.boneTable) {
+                if(bone >= model.affectedBoneNames.size())
+                    throw std::runtime_error(fmt::format("Part {} uses bone {}, which the model doesn't have.", i, bone));
+
+                const uint32_t joint = getBoneNode(model.affectedBoneNames[bone]);
+                joints.push_back(joint);
+                matrices.push_back(inverseBindMatrices[joint]);
+            }
+
+            document.ownedMatrices.push_back(std::move(matrices));
+            const auto& ownedMatrices = document.ownedMatrices.back();
+
+            const uint32_t view = document.addBufferView(ownedMatrices.data(), ownedMatrices.size() * sizeof(Matrix), 0, 0);
+            const uint32_t accessor = document.addAccessor(view, 0, floatType, ownedMatrices.size(), "MAT4");
+
+            document.skins.push_back(fmt::format(R"({{"inverseBindMatrices":{},"joints":[{}]}})", accessor, fmt::join(joints, ",")));
+
+            node += fmt::format(R"(,"skin":{})", document.skins.size() - 1);
+        }
+
+        document.sceneNodes.push_back(static_cast<uint32_t>(document.nodes.size()));
+        document.nodes.push_back(node + "}");
+    }
+
+    std::string json = fmt::format(R"({{"asset":{{"version":"2.0","generator":"libxiv"}},"scene":0,"scenes":[{{"nodes":[{}]}}])",
+                                   fmt::join(document.sceneNodes, ","));
+
+    const auto appendArray = [&json](const std::string_view name, const std::vector<std::string>& items) {
+        if(!items.empty())
+            json += fmt::format(R"(,"{}":{})", name, joinArray(items));
+    };
+
+    appendArray("nodes", document.nodes);
+    appendArray("meshes", document.meshes);
+    appendArray("skins", document.skins);
+    appendArray("accessors", document.accessors);
+    appendArray("bufferViews", document.bufferViews);
+
+    if(document.binaryLength > 0)
+        json += fmt::format(R"(,"buffers":[{{"byteLength":{}}}])", document.binaryLength);
+
+    json += "}";
+
+    // chunks have to be 4 byte aligned, JSON is padded with spaces
+    json.resize((json.size() + 3) & ~size_t(3), ' ');
+
+    const size_t totalLength = 12 + 8 + json.size() + (document.binaryLength > 0 ? 8 + document.binaryLength : 0);
+    if(totalLength > UINT32_MAX)
+        throw std::runtime_error("Model is too big for a GLB file.");
+
+    const auto writeUInt = [&stream](const uint32_t value) {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(uint32_t));
+    };
+
+    writeUInt(glbMagic);
+    writeUInt(glbVersion);
+    writeUInt(static_cast<uint32_t>(totalLength));
+
+    writeUInt(static_cast<uint32_t>(json.size()));
+    writeUInt(jsonChunkType);
+    stream.write(json.data(), static_cast<std::streamsize>(json.size()));
+
+    if(document.binaryLength > 0) {
+        writeUInt(static_cast<uint32_t>(document.binaryLength));
+        writeUInt(binaryChunkType);
+
+        constexpr char padding[3] = {};
+        for(const auto& segment : document.segments) {
+            stream.write(static_cast<const char*>(segment.data), static_cast<std::streamsize>(segment.size));
+            stream.write(padding, static_cast<std::streamsize>(((segment.size + 3) & ~size_t(3)) - segment.size));
+        }
+    }
+
+    if(!stream)
+        throw std::runtime_error("Failed to write GLB data.");
+}
+
+void writeGLB(const Model& model, const std::string_view path, const Skeleton* skeleton, const int lod) {
+    std::ofstream file(std::string(path), std::ios::binary);
+    if(!file)
+        throw std::runtime_error(fmt::format("Failed to open {} for writing.", path));
+
+    writeGLB(model, file, skeleton, lod);
+}
+
+void exportGLBs(const std::vector<GLBExportJob>& jobs, const size_t threadCount) {
+    parallelFor(jobs.size(), [&](const size_t i) {
+        const auto& job = jobs[i];
+        if(job.model == nullptr)
+            throw std::runtime_error("GLB export job " + job.path + " has no model.");
+
+        writeGLB(*job.model, job.path, job.skeleton, job.lod);
+    }, threadCount);
+}
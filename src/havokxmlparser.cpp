@@ -1,115 +1,246 @@
 #include "havokxmlparser.h"
 
-#include <pugixml.hpp>
-#include <fmt/core.h>
-#include <iostream>
-#include <algorithm>
+#include <charconv>
+#include <stdexcept>
+
+#include "memorybuffer.h"
+
+enum class XMLElementType {
+    Object,
+    Param,
+    Other
+};
+
+// an element that's still open, the name is the class of objects and the name attribute of params
+struct XMLElement {
+    XMLElementType type;
+    std::string_view name;
+};
+
+static std::string_view getAttribute(const std::string_view tag, const std::string_view attribute) {
+    const size_t start = tag.find(attribute);
+    if(start == std::string_view::npos)
+        return {};
+
+    const size_t valueStart = start + attribute.size();
+    const size_t valueEnd = tag.find('"', valueStart);
+    if(valueEnd == std::string_view::npos)
+        return {};
+
+    return tag.substr(valueStart, valueEnd - valueStart);
+}
+
+static bool isNumberSeparator(const char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '(' || c == ')';
+}
+
+// reads whitespace separated numbers, the parentheses around reference pose vectors are skipped too
+template<typename T>
+static void parseNumbers(const std::string_view text, std::vector<T>& numbers) {
+    const char* current = text.data();
+    const char* end = text.data() + text.size();
+
+    while(true) {
+        while(current != end && isNumberSeparator(*current))
+            current++;
+
+        if(current == end)
+            break;
+
+        T value;
+        const auto [next, error] = std::from_chars(current, end, value);
+        if(error != std::errc())
+            throw std::runtime_error("Havok XML has an invalid number.");
+
+        numbers.push_back(value);
+        current = next;
+    }
+}
 
-void walkSkeleton(Skeleton& skeleton, Bone *pBone, int level = 0);
+/*
+ * Returns the order the bones should be in so parents come first, each subtree is kept together. The order is only
+ * changed if the file isn't already sorted.
+ */
+static std::vector<int> getTopologicalOrder(const std::vector<int>& parentIndices) {
+    const int boneCount = static_cast<int>(parentIndices.size());
 
-inline std::vector<std::string> tokenize(const std::string_view string, const std::string_view& delimiters) {
-    std::vector<std::string> tokens;
+    std::vector<int> order(boneCount);
 
-    const size_t length = string.length();
-    size_t lastPos = 0;
+    bool sorted = true;
+    for(int i = 0; i < boneCount; i++) {
+        order[i] = i;
+        sorted &= parentIndices[i] < i;
+    }
+
+    if(sorted)
+        return order;
+
+    std::vector<std::vector<int>> children(boneCount);
+    std::vector<int> stack;
+
+    for(int i = boneCount - 1; i >= 0; i--) {
+        if(parentIndices[i] == -1)
+            stack.push_back(i);
+        else
+            children[parentIndices[i]].push_back(i);
+    }
+
+    order.clear();
 
-    while(lastPos < length + 1) {
-        size_t pos = string.find_first_of(delimiters, lastPos);
-        if(pos == std::string_view::npos)
-            pos = length;
+    while(!stack.empty()) {
+        const int bone = stack.back();
+        stack.pop_back();
 
-        if(pos != lastPos)
-            tokens.emplace_back(string.data() + lastPos, pos - lastPos);
+        order.push_back(bone);
 
-        lastPos = pos + 1;
+        // pushed in reverse, so children are visited in the order they're in the file
+        for(auto it = children[bone].rbegin(); it != children[bone].rend(); ++it)
+            stack.push_back(*it);
     }
 
-    return tokens;
+    // anything that wasn't reached is part of a cycle
+    if(order.size() != parentIndices.size())
+        throw std::runtime_error("Havok skeleton has a cycle in its bone hierarchy.");
+
+    return order;
 }
 
-Skeleton parseHavokXML(const std::string_view path) {
-    Skeleton skeleton;
+Skeleton parseHavokXMLData(const std::string_view xml) {
+    std::vector<XMLElement> stack;
+
+    // where the hkaSkeleton object is in the stack, -1 until it's found
+    int skeletonDepth = -1;
+
+    std::vector<std::string_view> names;
+    std::vector<int> parentIndices;
+    std::vector<float> referencePose;
+
+    size_t position = 0;
+    while(position < xml.size()) {
+        const size_t tagStart = xml.find('<', position);
+        if(tagStart == std::string_view::npos)
+            break;
+
+        // the text before this tag belongs to the innermost open param
+        if(skeletonDepth != -1 && tagStart > position && !stack.empty() && stack.back().type == XMLElementType::Param) {
+            const std::string_view text = xml.substr(position, tagStart - position);
+            const std::string_view param = stack.back().name;
+            const size_t depth = stack.size() - 1 - skeletonDepth;
+
+            if(depth == 1 && param == "parentIndices") {
+                parseNumbers(text, parentIndices);
+            } else if(depth == 1 && param == "referencePose") {
+                parseNumbers(text, referencePose);
+            } else if(depth == 3 && param == "name" && stack[skeletonDepth + 1].name == "bones") {
+                names.back() = text;
+            }
+        }
+
+        if(xml.compare(tagStart, 4, "<!--") == 0) {
+            const size_t commentEnd = xml.find("-->", tagStart);
+            position = commentEnd == std::string_view::npos ? xml.size() : commentEnd + 3;
+            continue;
+        }
+
+        const size_t tagEnd = xml.find('>', tagStart);
+        if(tagEnd == std::string_view::npos)
+            throw std::runtime_error("Havok XML has an unterminated tag.");
+
+        const std::string_view tag = xml.substr(tagStart + 1, tagEnd - tagStart - 1);
+        position = tagEnd + 1;
 
-    pugi::xml_document doc;
-    doc.load_file(path.data());
+        // the declaration and doctypes
+        if(tag.empty() || tag[0] == '?' || tag[0] == '!')
+            continue;
 
-    pugi::xpath_node build_tool = doc.select_node("//hkobject/hkparam[@name=\"bones\"]");
+        if(tag[0] == '/') {
+            if(stack.empty())
+                throw std::runtime_error("Havok XML has an unexpected closing tag.");
 
-    auto bonesNode = build_tool.node();
+            stack.pop_back();
 
-    fmt::print("num bones: {}\n", bonesNode.attribute("numelements").as_int());
+            // only the first skeleton is read
+            if(skeletonDepth != -1 && stack.size() == static_cast<size_t>(skeletonDepth))
+                break;
 
-    skeleton.bones.reserve(bonesNode.attribute("numelements").as_int());
+            continue;
+        }
+
+        if(tag.back() == '/')
+            continue;
 
-    for(auto node : bonesNode.children()) {
-        pugi::xpath_node name_node = node.select_node("./hkparam[@name=\"name\"]");
-        //fmt::print("{}\n", node.print());
-        name_node.node().print(std::cout);
+        XMLElement element = {XMLElementType::Other, {}};
 
-        Bone bone;
-        bone.name = name_node.node().text().as_string();
+        if(tag.compare(0, 8, "hkobject") == 0) {
+            element = {XMLElementType::Object, getAttribute(tag, " class=\"")};
 
-        fmt::print("bone {}\n", bone.name);
+            if(skeletonDepth == -1 && element.name == "hkaSkeleton")
+                skeletonDepth = static_cast<int>(stack.size());
+        } else if(tag.compare(0, 7, "hkparam") == 0) {
+            element = {XMLElementType::Param, getAttribute(tag, " name=\"")};
 
-        skeleton.bones.push_back(bone);
+            // added here instead of when the text is read, so bones with an empty name still count
+            if(skeletonDepth != -1 && stack.size() - skeletonDepth == 3 && element.name == "name" && stack[skeletonDepth + 1].name == "bones")
+                names.emplace_back();
+        }
+
+        stack.push_back(element);
     }
-    pugi::xpath_node parentNode = doc.select_node("//hkparam[@name=\"parentIndices\"]");
 
-    std::string text = parentNode.node().text().as_string();
-    std::replace(text.begin(), text.end(), '\n', ' ');
-    text.erase(std::remove(text.begin(), text.end(), '\t'), text.end());
+    if(skeletonDepth == -1)
+        throw std::runtime_error("Havok XML doesn't have a skeleton.");
 
-    auto parentIndices = tokenize(text, " ");
+    const size_t boneCount = names.size();
 
-    for(int i = 0; i < parentIndices.size(); i++) {
-        auto indice = std::atoi(parentIndices[i].c_str());
-        if(indice != -1)
-            skeleton.bones[i].parent = &skeleton.bones[indice];
-        else
-            skeleton.root_bone = &skeleton.bones[i];
+    if(parentIndices.size() != boneCount)
+        throw std::runtime_error("Havok skeleton has a different number of parent indices than bones.");
+
+    if(referencePose.size() > boneCount * 10)
+        throw std::runtime_error("Havok skeleton has more reference poses than bones.");
+
+    for(size_t i = 0; i < boneCount; i++) {
+        if(parentIndices[i] < -1 || parentIndices[i] >= static_cast<int>(boneCount) || parentIndices[i] == static_cast<int>(i))
+            throw std::runtime_error("Havok skeleton has an invalid parent index.");
     }
 
-    walkSkeleton(skeleton, skeleton.root_bone);
+    const std::vector<int> order = getTopologicalOrder(parentIndices);
 
-    pugi::xpath_node build_tool2 = doc.select_node("//hkobject/hkparam[@name=\"referencePose\"]");
+    std::vector<int> newIndices(boneCount);
+    for(size_t i = 0; i < boneCount; i++)
+        newIndices[order[i]] = static_cast<int>(i);
 
-    fmt::print("num ref poses: {}\n", build_tool2.node().attribute("numelements").as_int());
+    Skeleton skeleton;
+    skeleton.bones.resize(boneCount);
 
-    auto matrices = tokenize(build_tool2.node().text().as_string(), "\n");
-    int i = 0;
-    for(auto matrix : matrices) {
-        size_t firstParenthesis = matrix.find_first_of('(');
-        if(firstParenthesis != std::string::npos) {
-            matrix = matrix.substr(firstParenthesis);
-            std::replace(matrix.begin(), matrix.end(), ')', ' ');
-            matrix.erase(std::remove(matrix.begin(), matrix.end(), '('), matrix.end());
-            fmt::print("{}\n", matrix);
+    for(size_t i = 0; i < boneCount; i++) {
+        const int original = order[i];
 
-            auto tokens = tokenize(matrix, " ");
-            std::array<float, 3> position = {std::stof(tokens[0]), std::stof(tokens[1]), std::stof(tokens[2])};
-            std::array<float, 4> rotation = {std::stof(tokens[3]), std::stof(tokens[4]), std::stof(tokens[5]), std::stof(tokens[6])};
-            std::array<float, 3> scale = {std::stof(tokens[7]), std::stof(tokens[8]), std::stof(tokens[9])};
+        auto& bone = skeleton.bones[i];
+        bone.name = names[original];
+        bone.parentIndex = parentIndices[original] == -1 ? -1 : newIndices[parentIndices[original]];
 
-            skeleton.bones[i].position = position;
-            skeleton.bones[i].rotation = rotation;
-            skeleton.bones[i].scale = scale;
+        // each pose is a translation, a rotation quaternion and a scale
+        if((original + 1) * 10 <= static_cast<int>(referencePose.size())) {
+            const float* pose = &referencePose[original * 10];
+            bone.position = {pose[0], pose[1], pose[2]};
+            bone.rotation = {pose[3], pose[4], pose[5], pose[6]};
+            bone.scale = {pose[7], pose[8], pose[9]};
         }
+    }
 
-        i++;
+    // the bones won't move anymore, so pointers to them are safe now
+    for(auto& bone : skeleton.bones) {
+        if(bone.parentIndex != -1)
+            bone.parent = &skeleton.bones[bone.parentIndex];
+        else if(skeleton.root_bone == nullptr)
+            skeleton.root_bone = &bone;
     }
 
     return skeleton;
 }
 
-void walkSkeleton(Skeleton& skeleton, Bone *pBone, int level) {
-    for(int i = 0; i < level; i++)
-        fmt::print(" ");
-
-    fmt::print("- {}\n", pBone->name);
+Skeleton parseHavokXML(const std::string_view path) {
+    const MemoryBuffer buffer = read_file_to_buffer(path);
 
-    for(auto& bone : skeleton.bones) {
-        if(bone.parent == pBone) {
-            walkSkeleton(skeleton, &bone, level++);
-        }
-    }
+    return parseHavokXMLData(std::string_view(reinterpret_cast<const char*>(buffer.data.data()), buffer.size()));
 }
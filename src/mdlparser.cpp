@@ -7,6 +7,17 @@
 #include <array>
 #include <fstream>
 #include <algorithm>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define XIV_MDL_SSE2
+#endif
+
+#ifdef __F16C__
+#include <immintrin.h>
+#define XIV_MDL_F16C
+#endif
 
 struct ModelFileHeader {
     uint32_t version;
@@ -24,34 +35,6 @@ struct ModelFileHeader {
     uint8_t padding;
 };
 
-enum VertexType : uint8_t {
-    Single3 = 2,
-    Single4 = 3,
-    UInt = 5,
-    ByteFloat4 = 8,
-    Half2 = 13,
-    Half4 = 14
-};
-
-enum VertexUsage : uint8_t  {
-    Position = 0,
-    BlendWeights = 1,
-    BlendIndices = 2,
-    Normal = 3,
-    UV = 4,
-    Tangent2 = 5,
-    Tangent1 = 6,
-    Color = 7,
-};
-
-struct VertexElement {
-    uint8_t stream, offset;
-    VertexType type;
-    VertexUsage usage;
-    uint8_t usageIndex;
-    uint8_t padding[3];
-};
-
 enum ModelFlags1 : uint8_t
 {
     DustOcclusionEnabled = 0x80,
@@ -176,14 +159,146 @@ struct BoundingBox {
     std::array<float, 4> min, max;
 };
 
-Model parseMDL(MemorySpan data) {
+static size_t getVertexTypeSize(const VertexType type) {
+    switch(type) {
+        case VertexType::Single3:
+            return sizeof(float) * 3;
+        case VertexType::Single4:
+            return sizeof(float) * 4;
+        case VertexType::UInt:
+        case VertexType::ByteFloat4:
+        case VertexType::Half2:
+            return 4;
+        case VertexType::Half4:
+            return sizeof(uint16_t) * 4;
+    }
+
+    return 0;
+}
+
+// converts 4 halves at once
+static void halvesToFloats(const uint16_t* in, float* out) {
+#if defined(XIV_MDL_F16C)
+    _mm_storeu_ps(out, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in))));
+#elif defined(XIV_MDL_SSE2)
+    // branchless version of half_to_float, the exponent is rebiased with a multiply so denormals work too
+    const __m128i halves = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in)), _mm_setzero_si128());
+
+    const __m128i expmant = _mm_and_si128(halves, _mm_set1_epi32(0x7fff));
+    const __m128i sign = _mm_slli_epi32(_mm_xor_si128(halves, expmant), 16);
+
+    const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+    const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expmant, 13)), magic);
+
+    // infinity and NaN keep their exponent of all ones
+    const __m128i wasInfNan = _mm_cmpgt_epi32(expmant, _mm_set1_epi32(0x7bff));
+    const __m128 infNanExponent = _mm_and_ps(_mm_castsi128_ps(wasInfNan), _mm_castsi128_ps(_mm_set1_epi32(255 << 23)));
+
+    _mm_storeu_ps(out, _mm_or_ps(scaled, _mm_or_ps(_mm_castsi128_ps(sign), infNanExponent)));
+#else
+    for(int i = 0; i < 4; i++)
+        out[i] = half_to_float(in[i]);
+#endif
+}
+
+static void unormBytesToFloats(const uint8_t* in, float* out) {
+#ifdef XIV_MDL_SSE2
+    int32_t packed;
+    memcpy(&packed, in, sizeof(int32_t));
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bytes = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+
+    _mm_storeu_ps(out, _mm_div_ps(_mm_cvtepi32_ps(bytes), _mm_set1_ps(255.0f)));
+#else
+    for(int i = 0; i < 4; i++)
+        out[i] = byte_to_float(in[i]);
+#endif
+}
+
+// runs convert once per vertex, and copies the first components floats to the output
+template<typename Convert>
+static void decodeStrided(const uint8_t* in, const size_t inStride, const size_t count,
+                          uint8_t* out, const size_t outStride, const size_t components, Convert convert) {
+    float values[4];
+    for(size_t i = 0; i < count; i++) {
+        convert(in + i * inStride, values);
+        memcpy(out + i * outStride, values, components * sizeof(float));
+    }
+}
+
+/*
+ * Decodes one element of every vertex in a stream, in one pass. Vertices are inStride bytes apart in the input, and
+ * each output is outStride bytes apart.
+ */
+static void decodeFloatElement(const uint8_t* in, const size_t inStride, const size_t count, const VertexType type,
+                               uint8_t* out, const size_t outStride, const size_t components) {
+    switch(type) {
+        case VertexType::Single3:
+            decodeStrided(in, inStride, count, out, outStride, components, [](const uint8_t* vertex, float* values) {
+                memcpy(values, vertex, sizeof(float) * 3);
+                values[3] = 0.0f;
+            });
+            break;
+        case VertexType::Single4:
+            decodeStrided(in, inStride, count, out, outStride, components, [](const uint8_t* vertex, float* values) {
+                memcpy(values, vertex, sizeof(float) * 4);
+            });
+            break;
+        case VertexType::ByteFloat4:
+            decodeStrided(in, inStride, count, out, outStride, components, unormBytesToFloats);
+            break;
+        case VertexType::Half2:
+            decodeStrided(in, inStride, count, out, outStride, components, [](const uint8_t* vertex, float* values) {
+                uint16_t halves[4] = {};
+                memcpy(halves, vertex, sizeof(uint16_t) * 2);
+                halvesToFloats(halves, values);
+            });
+            break;
+        case VertexType::Half4:
+            decodeStrided(in, inStride, count, out, outStride, components, [](const uint8_t* vertex, float* values) {
+                uint16_t halves[4];
+                memcpy(halves, vertex, sizeof(uint16_t) * 4);
+                halvesToFloats(halves, values);
+            });
+            break;
+        case VertexType::UInt:
+            // not a float type, so this stays zeroed
+            break;
+    }
+}
+
+static void decodeByteElement(const uint8_t* in, const size_t inStride, const size_t count, const VertexType type,
+                              uint8_t* out, const size_t outStride) {
+    if(type != VertexType::UInt)
+        return;
+
+    for(size_t i = 0; i < count; i++)
+        memcpy(out + i * outStride, in + i * inStride, 4);
+}
+
+struct VertexDeclaration {
+    std::vector<VertexElement> elements;
+};
+
+// everything in the file before the vertex and index buffers
+struct ModelData {
+    ModelFileHeader fileHeader;
+    std::vector<VertexDeclaration> vertexDecls;
+    std::vector<uint8_t> strings;
+    ModelHeader header;
+    std::vector<MeshLod> lods;
+    std::vector<Mesh> meshes;
+    std::vector<Submesh> submeshes;
+    std::vector<uint32_t> materialNameOffsets;
+    std::vector<uint32_t> boneNameOffsets;
+    std::vector<BoneTable> boneTables;
+};
+
+static ModelData readModelData(MemorySpan& data) {
     ModelFileHeader modelFileHeader;
     data.read(&modelFileHeader);
 
-    struct VertexDeclaration {
-        std::vector<VertexElement> elements;
-    };
-
     std::vector<VertexDeclaration> vertexDecls(modelFileHeader.vertexDeclarationCount);
     for(int i = 0; i < modelFileHeader.vertexDeclarationCount; i++) {
         VertexElement element {};
@@ -290,110 +405,173 @@ Model parseMDL(MemorySpan data) {
     std::vector<BoundingBox> boneBoundingBoxes;
     data.read_structures(&boneBoundingBoxes, modelHeader.boneCount);
 
-    Model model;
+    ModelData modelData;
+    modelData.fileHeader = modelFileHeader;
+    modelData.vertexDecls = std::move(vertexDecls);
+    modelData.strings = std::move(strings);
+    modelData.header = modelHeader;
+    modelData.lods = std::move(lods);
+    modelData.meshes = std::move(meshes);
+    modelData.submeshes = std::move(submeshes);
+    modelData.materialNameOffsets = std::move(materialNameOffsets);
+    modelData.boneNameOffsets = std::move(boneNameOffsets);
+    modelData.boneTables = std::move(boneTables);
+
+    return modelData;
+}
+
+static std::string readModelString(const std::vector<uint8_t>& strings, uint32_t offset) {
+    std::string string;
+    while(offset < strings.size() && strings[offset] != '\0') {
+        string += static_cast<char>(strings[offset]);
+        offset++;
+    }
 
-    for(auto offset : boneNameOffsets) {
-        std::string name;
-        char nextChar = strings[offset];
-        while(nextChar != '\0') {
-            name += nextChar;
-            offset++;
-            nextChar = strings[offset];
-        }
+    return string;
+}
+
+// models extracted with only some of the LODs have a different layout than the one in the stack, so the offsets in
+// the file header are used when they're there
+static size_t getVertexDataOffset(const ModelData& modelData, const int lod) {
+    if(modelData.fileHeader.vertexOffsets[lod] != 0)
+        return modelData.fileHeader.vertexOffsets[lod];
+
+    return modelData.lods[lod].vertexDataOffset;
+}
 
-        model.affectedBoneNames.push_back(name);
+static std::vector<PartSubmesh> getPartSubmeshes(const ModelData& modelData, const Mesh& mesh) {
+    std::vector<PartSubmesh> partSubmeshes;
+
+    for(int k = mesh.subMeshIndex; k < (mesh.subMeshIndex + mesh.subMeshCount); k++) {
+        const auto& submesh = modelData.submeshes.at(k);
+
+        PartSubmesh partSubmesh;
+        partSubmesh.indexCount = submesh.indexCount;
+        partSubmesh.indexOffset = submesh.indexOffset;
+        partSubmesh.boneCount = submesh.boneCount;
+        partSubmesh.boneStartIndex = submesh.boneStartIndex;
+
+        partSubmeshes.push_back(partSubmesh);
     }
 
-    for(int i = 0; i < modelHeader.lodCount; i++) {
+    return partSubmeshes;
+}
+
+static std::vector<uint16_t> getPartBoneTable(const ModelData& modelData, const Mesh& mesh) {
+    // meshes without any skinning use 255 here
+    if(mesh.boneTableIndex >= modelData.boneTables.size())
+        return {};
+
+    const auto& boneTable = modelData.boneTables[mesh.boneTableIndex];
+    return {boneTable.boneIndex.begin(), boneTable.boneIndex.begin() + std::min<size_t>(boneTable.boneCount, 64)};
+}
+
+Model parseMDL(MemorySpan data, const MDLParseOptions& options) {
+    const ModelData modelData = readModelData(data);
+
+    const auto& modelFileHeader = modelData.fileHeader;
+    const auto& vertexDecls = modelData.vertexDecls;
+    const auto& lods = modelData.lods;
+    const auto& meshes = modelData.meshes;
+
+    Model model;
+
+    for(const auto offset : modelData.boneNameOffsets)
+        model.affectedBoneNames.push_back(readModelString(modelData.strings, offset));
+
+    for(int i = 0; i < modelData.header.lodCount; i++) {
         Lod lod;
 
+        // keep the empty LOD, so the indices still line up
+        if((options.lodMask & (1 << i)) == 0) {
+            model.lods.push_back(lod);
+            continue;
+        }
+
+        const size_t vertexDataOffset = getVertexDataOffset(modelData, i);
+
         for(int j = lods[i].meshIndex; j < (lods[i].meshIndex + lods[i].meshCount); j++) {
             Part part;
 
-            const VertexDeclaration decl = vertexDecls[j];
+            const VertexDeclaration& decl = vertexDecls[j];
 
-            int vertexCount = meshes[j].vertexCount;
-            std::vector<Vertex> vertices(vertexCount);
+            const size_t vertexCount = meshes[j].vertexCount;
+            std::vector<Vertex> vertices;
 
-            for(int k = meshes[j].subMeshIndex; k < (meshes[j].subMeshIndex + meshes[j].subMeshCount); k++) {
-                PartSubmesh submesh;
-                submesh.indexCount = submeshes[k].indexCount;
-                submesh.indexOffset = submeshes[k].indexOffset;
-                submesh.boneCount = submeshes[k].boneCount;
-                submesh.boneStartIndex = submeshes[k].boneStartIndex;
+            part.submeshes = getPartSubmeshes(modelData, meshes[j]);
+            part.startIndex = meshes[j].startIndex;
+            part.boneTable = getPartBoneTable(modelData, meshes[j]);
 
-                part.submeshes.push_back(submesh);
+            if(options.structureOfArrays) {
+                part.streams.positions.resize(vertexCount * 3);
+                part.streams.uvs.resize(vertexCount * 2);
+                part.streams.normals.resize(vertexCount * 3);
+                part.streams.boneWeights.resize(vertexCount * 4);
+                part.streams.boneIds.resize(vertexCount * 4);
+            } else {
+                vertices.resize(vertexCount);
             }
 
-            for(int k = 0; k < vertexCount; k++) {
-                for(auto& element : decl.elements) {
-                    data.seek(lods[i].vertexDataOffset + meshes[j].vertexBufferOffset[element.stream] + element.offset + meshes[i].vertexBufferStride[element.stream] * k, Seek::Set);
-
-                    std::array<float, 4> floatData = {};
-                    std::array<uint8_t, 4> intData = {};
-                    switch(element.type) {
-                        case VertexType::Single3:
-                            data.read_array(floatData.data(), 3);
-                            break;
-                        case VertexType::Single4:
-                            data.read_array(floatData.data(), 4);
-                            break;
-                        case VertexType::UInt:
-                            data.read_array(intData.data(), 4);
-                            break;
-                        case VertexType::ByteFloat4: {
-                            uint8_t values[4];
-                            data.read_array(values, 4);
-
-                            floatData[0] = byte_to_float(values[0]);
-                            floatData[1] = byte_to_float(values[1]);
-                            floatData[2] = byte_to_float(values[2]);
-                            floatData[3] = byte_to_float(values[3]);
-                        }
-                            break;
-                        case VertexType::Half2: {
-                            uint16_t values[2] = {};
-                            data.read_array(values, 2);
-
-                            floatData[0] = half_to_float(values[0]);
-                            floatData[1] = half_to_float(values[1]);
-                        }
-                            break;
-                        case VertexType::Half4: {
-                            uint16_t values[4] = {};
-                            data.read_array(values, 4);
-
-                            floatData[0] = half_to_float(values[0]);
-                            floatData[1] = half_to_float(values[1]);
-                            floatData[2] = half_to_float(values[2]);
-                            floatData[3] = half_to_float(values[3]);
-                        }
-                            break;
-                    }
-
-                    switch(element.usage) {
-                        case VertexUsage::Position:
-                            memcpy(vertices[k].position.data(), floatData.data(), sizeof(float) * 3);
-                            break;
-                        case VertexUsage::Normal:
-                            memcpy(vertices[k].normal.data(), floatData.data(), sizeof(float) * 3);
-                            break;
-                        case BlendWeights:
-                            memcpy(vertices[k].boneWeights.data(), floatData.data(), sizeof(float) * 4);
-                            break;
-                        case BlendIndices:
-                            memcpy(vertices[k].boneIds.data(), intData.data(), sizeof(uint8_t) * 4);
-                            break;
-                        case UV:
-                            memcpy(vertices[k].uv.data(), floatData.data(), sizeof(float) * 2);
-                            break;
-                        case Tangent2:
-                            break;
-                        case Tangent1:
-                            break;
-                        case Color:
-                            break;
-                    }
+            // each element is decoded for every vertex at once, instead of seeking for every element of every vertex
+            for(auto& element : decl.elements) {
+                if(vertexCount == 0)
+                    break;
+
+                if((options.usageMask & getVertexUsageBit(element.usage)) == 0)
+                    continue;
+
+                const size_t elementSize = getVertexTypeSize(element.type);
+                if(elementSize == 0)
+                    continue;
+
+                const size_t stride = meshes[j].vertexBufferStride[element.stream];
+                const size_t offset = vertexDataOffset + meshes[j].vertexBufferOffset[element.stream] + element.offset;
+
+                if(offset + stride * (vertexCount - 1) + elementSize > data.size())
+                    throw std::runtime_error("Vertex data is out of bounds.");
+
+                const uint8_t* in = data.raw_data() + offset;
+
+                auto* out = reinterpret_cast<uint8_t*>(vertices.data());
+                auto& streams = part.streams;
+
+                switch(element.usage) {
+                    case VertexUsage::Position:
+                        if(options.structureOfArrays)
+                            decodeFloatElement(in, stride, vertexCount, element.type, reinterpret_cast<uint8_t*>(streams.positions.data()), sizeof(float) * 3, 3);
+                        else
+                            decodeFloatElement(in, stride, vertexCount, element.type, out + offsetof(Vertex, position), sizeof(Vertex), 3);
+                        break;
+                    case VertexUsage::Normal:
+                        if(options.structureOfArrays)
+                            decodeFloatElement(in, stride, vertexCount, element.type, reinterpret_cast<uint8_t*>(streams.normals.data()), sizeof(float) * 3, 3);
+                        else
+                            decodeFloatElement(in, stride, vertexCount, element.type, out + offsetof(Vertex, normal), sizeof(Vertex), 3);
+                        break;
+                    case VertexUsage::BlendWeights:
+                        if(options.structureOfArrays)
+                            decodeFloatElement(in, stride, vertexCount, element.type, reinterpret_cast<uint8_t*>(streams.boneWeights.data()), sizeof(float) * 4, 4);
+                        else
+                            decodeFloatElement(in, stride, vertexCount, element.type, out + offsetof(Vertex, boneWeights), sizeof(Vertex), 4);
+                        break;
+                    case VertexUsage::BlendIndices:
+                        if(options.structureOfArrays)
+                            decodeByteElement(in, stride, vertexCount, element.type, streams.boneIds.data(), 4);
+                        else
+                            decodeByteElement(in, stride, vertexCount, element.type, out + offsetof(Vertex, boneIds), sizeof(Vertex));
+                        break;
+                    case VertexUsage::UV:
+                        if(options.structureOfArrays)
+                            decodeFloatElement(in, stride, vertexCount, element.type, reinterpret_cast<uint8_t*>(streams.uvs.data()), sizeof(float) * 2, 2);
+                        else
+                            decodeFloatElement(in, stride, vertexCount, element.type, out + offsetof(Vertex, uv), sizeof(Vertex), 2);
+                        break;
+                    case VertexUsage::Tangent2:
+                        break;
+                    case VertexUsage::Tangent1:
+                        break;
+                    case VertexUsage::Color:
+                        break;
                 }
             }
 
@@ -402,14 +580,77 @@ Model parseMDL(MemorySpan data) {
             std::vector<uint16_t> indices;
             data.read_structures(&indices, meshes[j].indexCount);
 
-            part.indices = indices;
-            part.vertices = vertices;
+            part.indices = std::move(indices);
+            part.vertices = std::move(vertices);
 
-            lod.parts.push_back(part);
+            lod.parts.push_back(std::move(part));
         }
 
         model.lods.push_back(lod);
     }
 
     return model;
-}
\ No newline at end of file
+}
+
+ModelView parseMDLView(MemorySpan data, const uint8_t lodMask) {
+    const ModelData modelData = readModelData(data);
+
+    ModelView view;
+
+    for(const auto offset : modelData.boneNameOffsets)
+        view.boneNames.push_back(readModelString(modelData.strings, offset));
+
+    for(const auto offset : modelData.materialNameOffsets)
+        view.materialNames.push_back(readModelString(modelData.strings, offset));
+
+    for(int i = 0; i < modelData.header.lodCount; i++) {
+        const auto& lod = modelData.lods[i];
+
+        LodView lodView;
+
+        if((lodMask & (1 << i)) == 0) {
+            view.lods.push_back(std::move(lodView));
+            continue;
+        }
+
+        for(int j = lod.meshIndex; j < (lod.meshIndex + lod.meshCount); j++) {
+            const auto& mesh = modelData.meshes.at(j);
+
+            MeshView meshView;
+            meshView.vertexCount = mesh.vertexCount;
+            meshView.elements = modelData.vertexDecls.at(j).elements;
+            meshView.materialIndex = mesh.materialIndex;
+            meshView.submeshes = getPartSubmeshes(modelData, mesh);
+            meshView.startIndex = mesh.startIndex;
+
+            for(int k = 0; k < std::min<int>(mesh.vertexStreamCount, 3); k++) {
+                VertexStreamView stream;
+                stream.stride = mesh.vertexBufferStride[k];
+                stream.size = stream.stride * mesh.vertexCount;
+
+                const size_t offset = getVertexDataOffset(modelData, i) + mesh.vertexBufferOffset[k];
+                if(offset + stream.size > data.size())
+                    throw std::runtime_error("Vertex data is out of bounds.");
+
+                stream.data = data.raw_data() + offset;
+
+                meshView.streams.push_back(stream);
+            }
+
+            const size_t indexOffset = modelData.fileHeader.indexOffsets[i] + mesh.startIndex * sizeof(uint16_t);
+            if(indexOffset + mesh.indexCount * sizeof(uint16_t) > data.size())
+                throw std::runtime_error("Index data is out of bounds.");
+
+            meshView.indices = data.raw_data() + indexOffset;
+            meshView.indexCount = mesh.indexCount;
+
+            meshView.boneTable = getPartBoneTable(modelData, mesh);
+
+            lodView.meshes.push_back(std::move(meshView));
+        }
+
+        view.lods.push_back(std::move(lodView));
+    }
+
+    return view;
+}
@@ -0,0 +1,579 @@
+#include "meshbvh.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#include "parallel.h"
+
+constexpr uint32_t bvhMagic = 0x42564958; // XIVB
+constexpr uint32_t bvhFormatVersion = 1;
+
+constexpr int binCount = 16;
+constexpr uint32_t maxLeafSize = 8;
+
+// subtrees smaller than this are always built on one thread, handing them out costs more than it saves
+constexpr uint32_t minimumSubtreeSize = 1024;
+
+using Vec3 = std::array<float, 3>;
+
+static Vec3 subtract(const Vec3& a, const Vec3& b) {
+    return {a[0] - b[0], a[1] - b[1], a[2] - b[2]};
+}
+
+static Vec3 add(const Vec3& a, const Vec3& b) {
+    return {a[0] + b[0], a[1] + b[1], a[2] + b[2]};
+}
+
+static Vec3 scale(const Vec3& a, const float scalar) {
+    return {a[0] * scalar, a[1] * scalar, a[2] * scalar};
+}
+
+static float dot(const Vec3& a, const Vec3& b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static Vec3 cross(const Vec3& a, const Vec3& b) {
+    return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+}
+
+struct Bounds {
+    Vec3 min = {INFINITY, INFINITY, INFINITY};
+    Vec3 max = {-INFINITY, -INFINITY, -INFINITY};
+
+    void extend(const Vec3& point) {
+        for(int i = 0; i < 3; i++) {
+            min[i] = std::min(min[i], point[i]);
+            max[i] = std::max(max[i], point[i]);
+        }
+    }
+
+    void extend(const Bounds& bounds) {
+        for(int i = 0; i < 3; i++) {
+            min[i] = std::min(min[i], bounds.min[i]);
+            max[i] = std::max(max[i], bounds.max[i]);
+        }
+    }
+
+    float getSurfaceArea() const {
+        if(min[0] > max[0])
+            return 0.0f;
+
+        const Vec3 extent = subtract(max, min);
+        return 2.0f * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+    }
+};
+
+struct BuildNode {
+    Bounds bounds;
+
+    uint32_t left = 0, right = 0;
+
+    // leaves have a count, the range is into BuildContext::order
+    uint32_t first = 0, count = 0;
+
+    uint8_t axis = 0;
+
+    // top level nodes that were left for a subtree to be built in their place
+    int32_t subtree = -1;
+};
+
+struct BuildContext {
+    std::vector<Bounds> triangleBounds;
+    std::vector<Vec3> centroids;
+
+    // triangle indices, every node owns a range of this
+    std::vector<uint32_t> order;
+};
+
+struct Bin {
+    Bounds bounds;
+    uint32_t count = 0;
+};
+
+static Bounds getRangeBounds(const BuildContext& context, const uint32_t begin, const uint32_t end) {
+    Bounds bounds;
+    for(uint32_t i = begin; i < end; i++)
+        bounds.extend(context.triangleBounds[context.order[i]]);
+
+    return bounds;
+}
+
+/*
+ * Partitions the range with the cheapest binned SAH split and returns where the second half starts. Returns begin
+ * if the range is cheaper to keep as a leaf.
+ */
+static uint32_t splitRange(BuildContext& context, const uint32_t begin, const uint32_t end, const Bounds& bounds, uint8_t& splitAxis) {
+    const uint32_t count = end - begin;
+    if(count <= 2)
+        return begin;
+
+    Bounds centroidBounds;
+    for(uint32_t i = begin; i < end; i++)
+        centroidBounds.extend(context.centroids[context.order[i]]);
+
+    int bestAxis = -1, bestBin = 0;
+    float bestCost = INFINITY;
+
+    for(int axis = 0; axis < 3; axis++) {
+        const float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+        if(extent <= 0.0f)
+            continue;
+
+        const float binScale = binCount / extent;
+
+        std::array<Bin, binCount> bins;
+        for(uint32_t i = begin; i < end; i++) {
+            const uint32_t triangle = context.order[i];
+            const int bin = std::min(binCount - 1, static_cast<int>((context.centroids[triangle][axis] - centroidBounds.min[axis]) * binScale));
+
+            bins[bin].count++;
+            bins[bin].bounds.extend(context.triangleBounds[triangle]);
+        }
+
+        // the cost of splitting after bin i, swept from both ends
+        std::array<float, binCount - 1> leftCosts;
+
+        Bounds leftBounds;
+        uint32_t leftCount = 0;
+        for(int i = 0; i < binCount - 1; i++) {
+            leftBounds.extend(bins[i].bounds);
+            leftCount += bins[i].count;
+            leftCosts[i] = leftBounds.getSurfaceArea() * leftCount;
+        }
+
+        Bounds rightBounds;
+        uint32_t rightCount = 0;
+        for(int i = binCount - 1; i > 0; i--) {
+            rightBounds.extend(bins[i].bounds);
+            rightCount += bins[i].count;
+
+            const float cost = leftCosts[i - 1] + rightBounds.getSurfaceArea() * rightCount;
+            if(rightCount > 0 && rightCount < count && cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = i;
+            }
+        }
+    }
+
+    // every centroid is in the same spot, so there's nothing to split on
+    if(bestAxis == -1) {
+        if(count <= maxLeafSize)
+            return begin;
+
+        splitAxis = 0;
+        return begin + count / 2;
+    }
+
+    // traversing costs about as much as testing one triangle
+    const float surfaceArea = bounds.getSurfaceArea();
+    const float splitCost = 1.0f + (surfaceArea > 0.0f ? bestCost / surfaceArea : 0.0f);
+    if(count <= maxLeafSize && splitCost >= static_cast<float>(count))
+        return begin;
+
+    const float binScale = binCount / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+    const auto middle = std::partition(context.order.begin() + begin, context.order.begin() + end, [&](const uint32_t triangle) {
+        const int bin = std::min(binCount - 1, static_cast<int>((context.centroids[triangle][bestAxis] - centroidBounds.min[bestAxis]) * binScale));
+        return bin < bestBin;
+    });
+
+    splitAxis = static_cast<uint8_t>(bestAxis);
+
+    return static_cast<uint32_t>(middle - context.order.begin());
+}
+
+/*
+ * Builds the tree for the range, until a range gets down to subtreeSize triangles. Those are left as placeholder nodes
+ * and added to subtrees, unless subtreeSize is 0.
+ */
+static uint32_t buildNode(BuildContext& context, std::vector<BuildNode>& nodes, const uint32_t begin, const uint32_t end,
+                          const uint32_t subtreeSize, std::vector<std::pair<uint32_t, uint32_t>>* subtrees) {
+    const auto index = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+
+    if(subtrees != nullptr && end - begin <= subtreeSize) {
+        nodes[index].subtree = static_cast<int32_t>(subtrees->size());
+        subtrees->emplace_back(begin, end);
+        return index;
+    }
+
+    nodes[index].bounds = getRangeBounds(context, begin, end);
+
+    uint8_t axis = 0;
+    const uint32_t middle = splitRange(context, begin, end, nodes[index].bounds, axis);
+
+    if(middle == begin) {
+        nodes[index].first = begin;
+        nodes[index].count = end - begin;
+        return index;
+    }
+
+    // nodes can be reallocated by the children, so this can't hold a reference
+    const uint32_t left = buildNode(context, nodes, begin, middle, subtreeSize, subtrees);
+    const uint32_t right = buildNode(context, nodes, middle, end, subtreeSize, subtrees);
+
+    nodes[index].left = left;
+    nodes[index].right = right;
+    nodes[index].axis = axis;
+
+    return index;
+}
+
+static void flattenNode(const std::vector<BuildNode>& nodes, const uint32_t index,
+                        const std::vector<std::vector<BuildNode>>& subtrees, std::vector<MeshBVHNode>& output) {
+    const auto& node = nodes[index];
+
+    if(node.subtree != -1) {
+        flattenNode(subtrees[node.subtree], 0, subtrees, output);
+        return;
+    }
+
+    const size_t outputIndex = output.size();
+
+    MeshBVHNode flatNode = {};
+    flatNode.boundsMin = node.bounds.min;
+    flatNode.boundsMax = node.bounds.max;
+    flatNode.axis = node.axis;
+
+    if(node.count > 0) {
+        flatNode.offset = node.first;
+        flatNode.triangleCount = static_cast<uint16_t>(node.count);
+        output.push_back(flatNode);
+        return;
+    }
+
+    output.push_back(flatNode);
+
+    // the first child goes right after its parent, so only the second one has to be stored
+    flattenNode(nodes, node.left, subtrees, output);
+    output[outputIndex].offset = static_cast<uint32_t>(output.size());
+    flattenNode(nodes, node.right, subtrees, output);
+}
+
+MeshBVH buildMeshBVH(const Lod& lod, size_t threadCount) {
+    std::vector<MeshBVHTriangle> triangles;
+
+    for(size_t i = 0; i < lod.parts.size(); i++) {
+        const auto& part = lod.parts[i];
+
+        if(part.vertices.empty() && !part.streams.positions.empty())
+            throw std::runtime_error("A BVH can't be built from parts parsed into PartStreams.");
+
+        for(size_t j = 0; j + 2 < part.indices.size(); j += 3) {
+            MeshBVHTriangle triangle;
+            triangle.part = static_cast<uint32_t>(i);
+            triangle.index = static_cast<uint32_t>(j);
+
+            for(int k = 0; k < 3; k++) {
+                const auto index = part.indices[j + k];
+                if(index >= part.vertices.size())
+                    throw std::runtime_error("Mesh index is out of range.");
+
+                triangle.positions[k] = part.vertices[index].position;
+            }
+
+            triangles.push_back(triangle);
+        }
+    }
+
+    MeshBVH bvh;
+    if(triangles.empty())
+        return bvh;
+
+    const auto triangleCount = static_cast<uint32_t>(triangles.size());
+
+    BuildContext context;
+    context.triangleBounds.resize(triangleCount);
+    context.centroids.resize(triangleCount);
+    context.order.resize(triangleCount);
+
+    for(uint32_t i = 0; i < triangleCount; i++) {
+        Bounds bounds;
+        for(const auto& position : triangles[i].positions)
+            bounds.extend(position);
+
+        context.triangleBounds[i] = bounds;
+        context.centroids[i] = scale(add(bounds.min, bounds.max), 0.5f);
+        context.order[i] = i;
+    }
+
+    if(threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // the upper levels are split on this thread until there's a few subtrees for every thread to pick from
+    const uint32_t subtreeSize = std::max<uint32_t>(minimumSubtreeSize, static_cast<uint32_t>(triangleCount / (threadCount * 4)));
+
+    std::vector<BuildNode> topNodes;
+    std::vector<std::pair<uint32_t, uint32_t>> subtreeRanges;
+    buildNode(context, topNodes, 0, triangleCount, subtreeSize, &subtreeRanges);
+
+    // every subtree owns a separate range of the order, so they can be partitioned at the same time
+    std::vector<std::vector<BuildNode>> subtrees(subtreeRanges.size());
+    parallelFor(subtreeRanges.size(), [&](const size_t i) {
+        buildNode(context, subtrees[i], subtreeRanges[i].first, subtreeRanges[i].second, 0, nullptr);
+    }, threadCount);
+
+    flattenNode(topNodes, 0, subtrees, bvh.nodes);
+
+    bvh.triangles.resize(triangleCount);
+    for(uint32_t i = 0; i < triangleCount; i++)
+        bvh.triangles[i] = triangles[context.order[i]];
+
+    return bvh;
+}
+
+static bool intersectsBounds(const MeshBVHNode& node, const Vec3& origin, const Vec3& inverseDirection, const float maxDistance) {
+    float entry = 0.0f, exit = maxDistance;
+
+    for(int i = 0; i < 3; i++) {
+        float planeEntry = (node.boundsMin[i] - origin[i]) * inverseDirection[i];
+        float planeExit = (node.boundsMax[i] - origin[i]) * inverseDirection[i];
+        if(planeEntry > planeExit)
+            std::swap(planeEntry, planeExit);
+
+        // written so NaNs, from a ray that's parallel and on the plane of a side, don't narrow the range
+        entry = planeEntry > entry ? planeEntry : entry;
+        exit = planeExit < exit ? planeExit : exit;
+    }
+
+    return entry <= exit;
+}
+
+// Möller-Trumbore, both sides of the triangle count
+static bool intersectTriangle(const MeshBVHTriangle& triangle, const Vec3& origin, const Vec3& direction,
+                              float& distance, float& u, float& v) {
+    const Vec3 edge1 = subtract(triangle.positions[1], triangle.positions[0]);
+    const Vec3 edge2 = subtract(triangle.positions[2], triangle.positions[0]);
+
+    const Vec3 p = cross(direction, edge2);
+    const float determinant = dot(edge1, p);
+    if(std::fabs(determinant) < 1e-12f)
+        return false;
+
+    const float inverseDeterminant = 1.0f / determinant;
+
+    const Vec3 t = subtract(origin, triangle.positions[0]);
+    u = dot(t, p) * inverseDeterminant;
+    if(u < 0.0f || u > 1.0f)
+        return false;
+
+    const Vec3 q = cross(t, edge1);
+    v = dot(direction, q) * inverseDeterminant;
+    if(v < 0.0f || u + v > 1.0f)
+        return false;
+
+    distance = dot(edge2, q) * inverseDeterminant;
+
+    return distance >= 0.0f;
+}
+
+std::optional<MeshBVHRayHit> intersectRay(const MeshBVH& bvh, const std::array<float, 3>& origin,
+                                          const std::array<float, 3>& direction, const float maxDistance) {
+    if(bvh.nodes.empty())
+        return {};
+
+    const Vec3 inverseDirection = {1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2]};
+
+    std::optional<MeshBVHRayHit> closestHit;
+    float closestDistance = maxDistance;
+
+    std::vector<uint32_t> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+
+    while(!stack.empty()) {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+
+        const auto& node = bvh.nodes[index];
+        if(!intersectsBounds(node, origin, inverseDirection, closestDistance))
+            continue;
+
+        if(node.triangleCount > 0) {
+            for(uint32_t i = node.offset; i < node.offset + node.triangleCount; i++) {
+                const auto& triangle = bvh.triangles[i];
+
+                float distance, u, v;
+                if(intersectTriangle(triangle, origin, direction, distance, u, v) && distance <= closestDistance) {
+                    closestDistance = distance;
+                    closestHit = MeshBVHRayHit{distance, u, v, triangle.part, triangle.index};
+                }
+            }
+
+            continue;
+        }
+
+        // the child on the side the ray comes from goes on top, so it's visited first
+        if(direction[node.axis] < 0.0f) {
+            stack.push_back(index + 1);
+            stack.push_back(node.offset);
+        } else {
+            stack.push_back(node.offset);
+            stack.push_back(index + 1);
+        }
+    }
+
+    return closestHit;
+}
+
+static float getBoundsDistanceSquared(const MeshBVHNode& node, const Vec3& position) {
+    float distance = 0.0f;
+    for(int i = 0; i < 3; i++) {
+        const float outside = std::max({node.boundsMin[i] - position[i], 0.0f, position[i] - node.boundsMax[i]});
+        distance += outside * outside;
+    }
+
+    return distance;
+}
+
+// from Real-Time Collision Detection, which finds the voronoi region of the triangle the point is in
+static Vec3 getClosestPointOnTriangle(const MeshBVHTriangle& triangle, const Vec3& position) {
+    const Vec3& a = triangle.positions[0];
+    const Vec3& b = triangle.positions[1];
+    const Vec3& c = triangle.positions[2];
+
+    const Vec3 ab = subtract(b, a);
+    const Vec3 ac = subtract(c, a);
+    const Vec3 ap = subtract(position, a);
+
+    const float d1 = dot(ab, ap);
+    const float d2 = dot(ac, ap);
+    if(d1 <= 0.0f && d2 <= 0.0f)
+        return a;
+
+    const Vec3 bp = subtract(position, b);
+    const float d3 = dot(ab, bp);
+    const float d4 = dot(ac, bp);
+    if(d3 >= 0.0f && d4 <= d3)
+        return b;
+
+    const float vc = d1 * d4 - d3 * d2;
+    if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return add(a, scale(ab, d1 / (d1 - d3)));
+
+    const Vec3 cp = subtract(position, c);
+    const float d5 = dot(ab, cp);
+    const float d6 = dot(ac, cp);
+    if(d6 >= 0.0f && d5 <= d6)
+        return c;
+
+    const float vb = d5 * d2 - d1 * d6;
+    if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return add(a, scale(ac, d2 / (d2 - d6)));
+
+    const float va = d3 * d6 - d5 * d4;
+    if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return add(b, scale(subtract(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+
+    const float denominator = 1.0f / (va + vb + vc);
+    return add(a, add(scale(ab, vb * denominator), scale(ac, vc * denominator)));
+}
+
+std::optional<MeshBVHClosestPoint> findClosestPoint(const MeshBVH& bvh, const std::array<float, 3>& position, const float maxDistance) {
+    if(bvh.nodes.empty())
+        return {};
+
+    std::optional<MeshBVHClosestPoint> closestPoint;
+    float closestDistanceSquared = maxDistance * maxDistance;
+
+    std::vector<uint32_t> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+
+    while(!stack.empty()) {
+        const uint32_t index = stack.back();
+        stack.pop_back();
+
+        const auto& node = bvh.nodes[index];
+        if(getBoundsDistanceSquared(node, position) > closestDistanceSquared)
+            continue;
+
+        if(node.triangleCount > 0) {
+            for(uint32_t i = node.offset; i < node.offset + node.triangleCount; i++) {
+                const auto& triangle = bvh.triangles[i];
+
+                const Vec3 point = getClosestPointOnTriangle(triangle, position);
+                const Vec3 offset = subtract(point, position);
+
+                const float distanceSquared = dot(offset, offset);
+                if(distanceSquared <= closestDistanceSquared) {
+                    closestDistanceSquared = distanceSquared;
+                    closestPoint = MeshBVHClosestPoint{point, std::sqrt(distanceSquared), triangle.part, triangle.index};
+                }
+            }
+
+            continue;
+        }
+
+        // the nearer child goes on top, so the search radius shrinks as quickly as possible
+        const uint32_t first = index + 1, second = node.offset;
+        if(getBoundsDistanceSquared(bvh.nodes[first], position) < getBoundsDistanceSquared(bvh.nodes[second], position)) {
+            stack.push_back(second);
+            stack.push_back(first);
+        } else {
+            stack.push_back(first);
+            stack.push_back(second);
+        }
+    }
+
+    return closestPoint;
+}
+
+void writeMeshBVH(const MeshBVH& bvh, MemoryBuffer& buffer) {
+    buffer.write(bvhMagic);
+    buffer.write(bvhFormatVersion);
+
+    buffer.write(static_cast<uint32_t>(bvh.nodes.size()));
+    buffer.write_bytes(bvh.nodes.data(), bvh.nodes.size() * sizeof(MeshBVHNode));
+
+    buffer.write(static_cast<uint32_t>(bvh.triangles.size()));
+    buffer.write_bytes(bvh.triangles.data(), bvh.triangles.size() * sizeof(MeshBVHTriangle));
+}
+
+template<typename T>
+static bool readArray(MemorySpan& span, std::vector<T>& array) {
+    if(span.current_position() + sizeof(uint32_t) > span.size())
+        return false;
+
+    uint32_t count;
+    span.read(&count);
+
+    if(span.current_position() + static_cast<size_t>(count) * sizeof(T) > span.size())
+        return false;
+
+    array.resize(count);
+    memcpy(array.data(), span.raw_data() + span.current_position(), count * sizeof(T));
+    span.seek(count * sizeof(T), Seek::Current);
+
+    return true;
+}
+
+std::optional<MeshBVH> readMeshBVH(MemorySpan& span) {
+    if(span.current_position() + sizeof(uint32_t) * 2 > span.size())
+        return {};
+
+    uint32_t magic = 0, formatVersion = 0;
+    span.read(&magic);
+    span.read(&formatVersion);
+
+    if(magic != bvhMagic || formatVersion != bvhFormatVersion)
+        return {};
+
+    MeshBVH bvh;
+    if(!readArray(span, bvh.nodes) || !readArray(span, bvh.triangles))
+        throw std::runtime_error("Mesh BVH is truncated.");
+
+    // make sure a corrupted file can't send the queries out of bounds
+    for(size_t i = 0; i < bvh.nodes.size(); i++) {
+        const auto& node = bvh.nodes[i];
+
+        const bool valid = node.triangleCount > 0 ? static_cast<size_t>(node.offset) + node.triangleCount <= bvh.triangles.size()
+                                                  : node.offset > i + 1 && node.offset < bvh.nodes.size() && node.axis < 3;
+        if(!valid)
+            throw std::runtime_error("Mesh BVH is corrupted.");
+    }
+
+    return bvh;
+}
@@ -0,0 +1,371 @@
+#include "meshprocessing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include "parallel.h"
+
+double calculateACMR(const std::vector<uint16_t>& indices, size_t vertexCount, const uint32_t cacheSize) {
+    const size_t triangleCount = indices.size() / 3;
+    if(triangleCount == 0)
+        return 0.0;
+
+    for(const auto index : indices)
+        vertexCount = std::max<size_t>(vertexCount, index + 1);
+
+    // the miss count when each vertex was last put in the cache, 0 if it never was
+    std::vector<size_t> insertedAt(vertexCount, 0);
+    size_t misses = 0;
+
+    for(size_t i = 0; i < triangleCount * 3; i++) {
+        const auto index = indices[i];
+
+        // a FIFO cache only drops a vertex after cacheSize other vertices have been put in it
+        if(insertedAt[index] != 0 && misses - insertedAt[index] < cacheSize)
+            continue;
+
+        misses++;
+        insertedAt[index] = misses;
+    }
+
+    return static_cast<double>(misses) / static_cast<double>(triangleCount);
+}
+
+static std::vector<Vertex> gatherStreams(const PartStreams& streams) {
+    std::vector<Vertex> vertices(streams.positions.size() / 3);
+
+    for(size_t i = 0; i < vertices.size(); i++) {
+        auto& vertex = vertices[i];
+        memcpy(vertex.position.data(), &streams.positions[i * 3], sizeof(float) * 3);
+        memcpy(vertex.uv.data(), &streams.uvs[i * 2], sizeof(float) * 2);
+        memcpy(vertex.normal.data(), &streams.normals[i * 3], sizeof(float) * 3);
+        memcpy(vertex.boneWeights.data(), &streams.boneWeights[i * 4], sizeof(float) * 4);
+        memcpy(vertex.boneIds.data(), &streams.boneIds[i * 4], 4);
+    }
+
+    return vertices;
+}
+
+static void scatterStreams(const std::vector<Vertex>& vertices, PartStreams& streams) {
+    const size_t vertexCount = vertices.size();
+
+    streams.positions.resize(vertexCount * 3);
+    streams.uvs.resize(vertexCount * 2);
+    streams.normals.resize(vertexCount * 3);
+    streams.boneWeights.resize(vertexCount * 4);
+    streams.boneIds.resize(vertexCount * 4);
+
+    for(size_t i = 0; i < vertexCount; i++) {
+        const auto& vertex = vertices[i];
+        memcpy(&streams.positions[i * 3], vertex.position.data(), sizeof(float) * 3);
+        memcpy(&streams.uvs[i * 2], vertex.uv.data(), sizeof(float) * 2);
+        memcpy(&streams.normals[i * 3], vertex.normal.data(), sizeof(float) * 3);
+        memcpy(&streams.boneWeights[i * 4], vertex.boneWeights.data(), sizeof(float) * 4);
+        memcpy(&streams.boneIds[i * 4], vertex.boneIds.data(), 4);
+    }
+}
+
+static size_t hashVertex(const Vertex& vertex) {
+    return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(&vertex), sizeof(Vertex)));
+}
+
+static void deduplicateVertices(std::vector<Vertex>& vertices, std::vector<uint16_t>& indices) {
+    constexpr uint32_t emptySlot = UINT32_MAX;
+
+    // an open addressing table that's at most half full, the same as ExcelStringPool
+    size_t tableSize = 64;
+    while(tableSize < vertices.size() * 2)
+        tableSize *= 2;
+
+    std::vector<uint32_t> table(tableSize, emptySlot);
+    const size_t mask = tableSize - 1;
+
+    std::vector<uint16_t> remap(vertices.size());
+    std::vector<Vertex> unique;
+    unique.reserve(vertices.size());
+
+    for(size_t i = 0; i < vertices.size(); i++) {
+        size_t slot = hashVertex(vertices[i]) & mask;
+        while(table[slot] != emptySlot && memcmp(&unique[table[slot]], &vertices[i], sizeof(Vertex)) != 0)
+            slot = (slot + 1) & mask;
+
+        if(table[slot] == emptySlot) {
+            table[slot] = static_cast<uint32_t>(unique.size());
+            unique.push_back(vertices[i]);
+        }
+
+        remap[i] = static_cast<uint16_t>(table[slot]);
+    }
+
+    for(auto& index : indices)
+        index = remap[index];
+
+    vertices = std::move(unique);
+}
+
+static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint16_t>& indices) {
+    constexpr uint32_t unused = UINT32_MAX;
+
+    std::vector<uint32_t> remap(vertices.size(), unused);
+    uint32_t nextIndex = 0;
+
+    for(auto& index : indices) {
+        if(remap[index] == unused)
+            remap[index] = nextIndex++;
+
+        index = static_cast<uint16_t>(remap[index]);
+    }
+
+    std::vector<Vertex> reordered(nextIndex);
+    for(size_t i = 0; i < vertices.size(); i++) {
+        if(remap[i] != unused)
+            reordered[remap[i]] = vertices[i];
+    }
+
+    vertices = std::move(reordered);
+}
+
+// the tuning values from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+constexpr float cacheDecayPower = 1.5f;
+constexpr float lastTriangleScore = 0.75f;
+constexpr float valenceBoostScale = 2.0f;
+
+static float getVertexScore(const int cachePosition, const uint32_t remainingTriangles, const uint32_t cacheSize) {
+    // nothing left to draw with this vertex
+    if(remainingTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if(cachePosition >= 0) {
+        // the vertices of the last triangle get a fixed score, so the next triangle doesn't just reuse the same edge
+        if(cachePosition < 3) {
+            score = lastTriangleScore;
+        } else {
+            const float scale = 1.0f / static_cast<float>(cacheSize - 3);
+            score = std::pow(1.0f - static_cast<float>(cachePosition - 3) * scale, cacheDecayPower);
+        }
+    }
+
+    // vertices with only a few triangles left are boosted, so they're finished off instead of left behind
+    score += valenceBoostScale / std::sqrt(static_cast<float>(remainingTriangles));
+
+    return score;
+}
+
+/*
+ * Reorders the triangles of indices[0, indexCount) with Forsyth's algorithm, which greedily picks the triangle whose
+ * vertices are the most likely to still be in the cache.
+ */
+static void optimizeVertexCache(uint16_t* indices, const size_t indexCount, const size_t vertexCount, const uint32_t cacheSize) {
+    const size_t triangleCount = indexCount / 3;
+    if(triangleCount < 2)
+        return;
+
+    // the triangles that use each vertex, as a flat list
+    std::vector<uint32_t> remainingTriangles(vertexCount, 0);
+    for(size_t i = 0; i < indexCount; i++)
+        remainingTriangles[indices[i]]++;
+
+    std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+    for(size_t i = 0; i < vertexCount; i++)
+        triangleOffsets[i + 1] = triangleOffsets[i] + remainingTriangles[i];
+
+    std::vector<uint32_t> adjacency(indexCount);
+    {
+        std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for(size_t i = 0; i < indexCount; i++)
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for(size_t i = 0; i < vertexCount; i++)
+        vertexScores[i] = getVertexScore(-1, remainingTriangles[i], cacheSize);
+
+    const auto getTriangleScore = [&](const size_t triangle) {
+        return vertexScores[indices[triangle * 3]] + vertexScores[indices[triangle * 3 + 1]] + vertexScores[indices[triangle * 3 + 2]];
+    };
+
+    std::vector<bool> emitted(triangleCount, false);
+
+    int64_t bestTriangle = -1;
+    float bestScore = -1.0f;
+    for(size_t i = 0; i < triangleCount; i++) {
+        if(const float score = getTriangleScore(i); score > bestScore) {
+            bestScore = score;
+            bestTriangle = static_cast<int64_t>(i);
+        }
+    }
+
+    std::vector<uint16_t> output;
+    output.reserve(triangleCount * 3);
+
+    std::vector<uint16_t> cache, newCache;
+    cache.reserve(cacheSize + 3);
+    newCache.reserve(cacheSize + 3);
+
+    size_t scanPosition = 0;
+
+    for(size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+        // nothing in the cache has triangles left, so start over somewhere else
+        if(bestTriangle < 0) {
+            while(emitted[scanPosition])
+                scanPosition++;
+
+            bestTriangle = static_cast<int64_t>(scanPosition);
+        }
+
+        const auto triangle = static_cast<uint32_t>(bestTriangle);
+        emitted[triangle] = true;
+
+        newCache.clear();
+
+        for(int k = 0; k < 3; k++) {
+            const uint16_t vertex = indices[triangle * 3 + k];
+            output.push_back(vertex);
+
+            if(std::find(newCache.begin(), newCache.end(), vertex) == newCache.end())
+                newCache.push_back(vertex);
+
+            // remove the triangle from the ones left for this vertex
+            const auto begin = adjacency.begin() + triangleOffsets[vertex];
+            const auto end = begin + remainingTriangles[vertex];
+            const auto it = std::find(begin, end, triangle);
+            if(it != end) {
+                std::iter_swap(it, end - 1);
+                remainingTriangles[vertex]--;
+            }
+        }
+
+        for(const auto vertex : cache) {
+            if(std::find(newCache.begin(), newCache.end(), vertex) == newCache.end())
+                newCache.push_back(vertex);
+        }
+
+        for(size_t i = 0; i < newCache.size(); i++) {
+            const auto vertex = newCache[i];
+            cachePositions[vertex] = i < cacheSize ? static_cast<int>(i) : -1;
+            vertexScores[vertex] = getVertexScore(cachePositions[vertex], remainingTriangles[vertex], cacheSize);
+        }
+
+        // only the triangles around vertices that moved in the cache changed their score
+        bestTriangle = -1;
+        bestScore = -1.0f;
+
+        for(const auto vertex : newCache) {
+            const auto begin = adjacency.begin() + triangleOffsets[vertex];
+            const auto end = begin + remainingTriangles[vertex];
+
+            for(auto it = begin; it != end; ++it) {
+                if(const float score = getTriangleScore(*it); score > bestScore) {
+                    bestScore = score;
+                    bestTriangle = *it;
+                }
+            }
+        }
+
+        if(newCache.size() > cacheSize)
+            newCache.resize(cacheSize);
+
+        std::swap(cache, newCache);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+/*
+ * Returns the [start, start + count) index ranges of the submeshes, or nothing if they can't be reordered safely.
+ * Submesh offsets point into the index buffer of the whole LOD, so they're made relative to where the part starts.
+ */
+static std::optional<std::vector<std::pair<size_t, size_t>>> getSubmeshRanges(const Part& part) {
+    std::vector<std::pair<size_t, size_t>> ranges;
+
+    if(part.submeshes.empty()) {
+        ranges.emplace_back(0, part.indices.size() - part.indices.size() % 3);
+        return ranges;
+    }
+
+    for(const auto& submesh : part.submeshes) {
+        if(submesh.indexOffset < part.startIndex)
+            return {};
+
+        const size_t start = submesh.indexOffset - part.startIndex;
+        if(start % 3 != 0 || submesh.indexCount % 3 != 0 || start + submesh.indexCount > part.indices.size())
+            return {};
+
+        ranges.emplace_back(start, submesh.indexCount);
+    }
+
+    std::sort(ranges.begin(), ranges.end());
+
+    for(size_t i = 1; i < ranges.size(); i++) {
+        if(ranges[i - 1].first + ranges[i - 1].second > ranges[i].first)
+            return {};
+    }
+
+    return ranges;
+}
+
+MeshProcessingStats processPart(Part& part, const MeshProcessingOptions& options) {
+    const bool usesStreams = part.vertices.empty() && !part.streams.positions.empty();
+
+    const size_t vertexCount = usesStreams ? part.streams.positions.size() / 3 : part.vertices.size();
+    for(const auto index : part.indices) {
+        if(index >= vertexCount)
+            throw std::runtime_error("Mesh index is out of range.");
+    }
+
+    std::vector<Vertex> vertices = usesStreams ? gatherStreams(part.streams) : std::move(part.vertices);
+
+    // the cache size has to be bigger than the 3 vertices of the last triangle
+    const uint32_t cacheSize = std::max(options.cacheSize, 4u);
+
+    MeshProcessingStats stats;
+    stats.vertexCountBefore = vertices.size();
+    stats.acmrBefore = calculateACMR(part.indices, vertices.size(), cacheSize);
+
+    if(options.deduplicateVertices)
+        deduplicateVertices(vertices, part.indices);
+
+    if(options.optimizeVertexCache) {
+        if(const auto ranges = getSubmeshRanges(part)) {
+            for(const auto& [start, count] : *ranges)
+                optimizeVertexCache(part.indices.data() + start, count, vertices.size(), cacheSize);
+        }
+    }
+
+    // this goes last, so the vertices end up in the order of the optimized triangles
+    if(options.optimizeVertexFetch)
+        optimizeVertexFetch(vertices, part.indices);
+
+    stats.vertexCountAfter = vertices.size();
+    stats.acmrAfter = calculateACMR(part.indices, vertices.size(), cacheSize);
+
+    if(usesStreams)
+        scatterStreams(vertices, part.streams);
+    else
+        part.vertices = std::move(vertices);
+
+    return stats;
+}
+
+std::vector<MeshProcessingStats> processModel(Model& model, const MeshProcessingOptions& options, const size_t threadCount) {
+    std::vector<Part*> parts;
+    for(auto& lod : model.lods) {
+        for(auto& part : lod.parts)
+            parts.push_back(&part);
+    }
+
+    std::vector<MeshProcessingStats> stats(parts.size());
+
+    parallelFor(parts.size(), [&](const size_t i) {
+        stats[i] = processPart(*parts[i], options);
+    }, threadCount);
+
+    return stats;
+}
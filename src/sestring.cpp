@@ -0,0 +1,260 @@
+#include "sestring.h"
+
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define XIV_SESTRING_SSE2
+#endif
+
+constexpr uint8_t payloadStart = 0x02;
+constexpr uint8_t payloadEnd = 0x03;
+
+const uint8_t* findByte(const uint8_t* begin, const uint8_t* end, const uint8_t value) {
+    const uint8_t* it = begin;
+
+#ifdef XIV_SESTRING_SSE2
+    // most excel strings are short, so this only compares 16 bytes at a time and never reads past the end
+    const __m128i needle = _mm_set1_epi8(static_cast<char>(value));
+    for(; it + 16 <= end; it += 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if(mask != 0) {
+            while((mask & 1) == 0) {
+                mask >>= 1;
+                it++;
+            }
+
+            return it;
+        }
+    }
+#endif
+
+    for(; it < end; it++) {
+        if(*it == value)
+            return it;
+    }
+
+    return end;
+}
+
+static uint8_t readByte(std::string_view& data) {
+    if(data.empty())
+        throw std::runtime_error("SeString is truncated.");
+
+    const auto value = static_cast<uint8_t>(data.front());
+    data.remove_prefix(1);
+
+    return value;
+}
+
+uint32_t readSeStringInteger(std::string_view& data) {
+    const uint8_t marker = readByte(data);
+
+    if(marker < 0xF0)
+        return marker - 1;
+
+    // the low nibble of marker + 1 says which of the four bytes follow, from the most significant one down
+    const uint8_t flags = (marker + 1) & 0xF;
+
+    uint32_t value = 0;
+    if(flags & 8)
+        value |= static_cast<uint32_t>(readByte(data)) << 24;
+    if(flags & 4)
+        value |= static_cast<uint32_t>(readByte(data)) << 16;
+    if(flags & 2)
+        value |= static_cast<uint32_t>(readByte(data)) << 8;
+    if(flags & 1)
+        value |= readByte(data);
+
+    return value;
+}
+
+// moves data past one expression, including any operands
+static void skipExpression(std::string_view& data) {
+    const auto type = static_cast<uint8_t>(data.front());
+
+    if((type >= 0xF0 && type <= 0xFE) || type < 0xD0) {
+        readSeStringInteger(data);
+    } else if(type >= 0xE0 && type <= 0xE5) {
+        // binary comparisons
+        data.remove_prefix(1);
+        if(data.empty())
+            throw std::runtime_error("SeString is truncated.");
+        skipExpression(data);
+        if(data.empty())
+            throw std::runtime_error("SeString is truncated.");
+        skipExpression(data);
+    } else if(type >= 0xE8 && type <= 0xEC) {
+        // parameter lookups
+        data.remove_prefix(1);
+        if(data.empty())
+            throw std::runtime_error("SeString is truncated.");
+        skipExpression(data);
+    } else if(type == 0xFF) {
+        data.remove_prefix(1);
+
+        const uint32_t length = readSeStringInteger(data);
+        if(length > data.size())
+            throw std::runtime_error("SeString is truncated.");
+
+        data.remove_prefix(length);
+    } else {
+        // placeholders like the player's name, these have no operands
+        data.remove_prefix(1);
+    }
+}
+
+bool SeStringExpression::isInteger() const {
+    return (type >= 0x01 && type < 0xD0) || (type >= 0xF0 && type <= 0xFE);
+}
+
+bool SeStringExpression::isString() const {
+    return type == 0xFF;
+}
+
+uint32_t SeStringExpression::getInteger() const {
+    if(!isInteger())
+        throw std::runtime_error("SeString expression is not an integer.");
+
+    std::string_view view = data;
+    return readSeStringInteger(view);
+}
+
+std::string_view SeStringExpression::getString() const {
+    if(!isString())
+        throw std::runtime_error("SeString expression is not a string.");
+
+    std::string_view view = data.substr(1);
+    const uint32_t length = readSeStringInteger(view);
+
+    return view.substr(0, length);
+}
+
+size_t SeStringPayload::getExpressionCount() const {
+    size_t count = 0;
+
+    std::string_view view = body;
+    while(!view.empty()) {
+        skipExpression(view);
+        count++;
+    }
+
+    return count;
+}
+
+SeStringExpression SeStringPayload::getExpression(const size_t index) const {
+    std::string_view view = body;
+
+    for(size_t i = 0; i < index; i++) {
+        if(view.empty())
+            throw std::runtime_error("SeString expression index is out of range.");
+
+        skipExpression(view);
+    }
+
+    if(view.empty())
+        throw std::runtime_error("SeString expression index is out of range.");
+
+    const std::string_view start = view;
+    skipExpression(view);
+
+    SeStringExpression expression;
+    expression.type = static_cast<uint8_t>(start.front());
+    expression.data = start.substr(0, start.size() - view.size());
+
+    return expression;
+}
+
+SeStringView::Iterator::Iterator(const std::string_view string, const size_t position) : string(string), position(position) {
+    decode();
+}
+
+SeStringView::Iterator& SeStringView::Iterator::operator++() {
+    position = next;
+    decode();
+
+    return *this;
+}
+
+void SeStringView::Iterator::decode() {
+    if(position >= string.size()) {
+        position = next = string.size();
+        return;
+    }
+
+    const auto begin = reinterpret_cast<const uint8_t*>(string.data());
+    const auto end = begin + string.size();
+
+    segment = {};
+
+    if(begin[position] != payloadStart) {
+        const uint8_t* marker = findByte(begin + position, end, payloadStart);
+
+        next = marker - begin;
+        segment.text = string.substr(position, next - position);
+        return;
+    }
+
+    std::string_view view = string.substr(position + 1);
+    const uint8_t type = readByte(view);
+    const uint32_t length = readSeStringInteger(view);
+
+    if(length >= view.size() || static_cast<uint8_t>(view[length]) != payloadEnd)
+        throw std::runtime_error("SeString payload is truncated.");
+
+    segment.isPayload = true;
+    segment.payload.type = static_cast<SeStringMacro>(type);
+    segment.payload.body = view.substr(0, length);
+
+    next = (view.data() - string.data()) + length + 1;
+}
+
+bool SeStringView::hasPayloads() const {
+    const auto begin = reinterpret_cast<const uint8_t*>(data.data());
+    const auto end = begin + data.size();
+
+    return findByte(begin, end, payloadStart) != end;
+}
+
+std::string SeStringView::toPlainText() const {
+    std::string text;
+    appendPlainText(text);
+
+    return text;
+}
+
+void SeStringView::appendPlainText(std::string& out) const {
+    // most strings have no payloads at all
+    if(!hasPayloads()) {
+        out.append(data);
+        return;
+    }
+
+    for(const auto& segment : *this) {
+        if(!segment.isPayload) {
+            out.append(segment.text);
+            continue;
+        }
+
+        switch(segment.payload.type) {
+            case SeStringMacro::NewLine:
+                out += '\n';
+                break;
+            case SeStringMacro::Hyphen:
+                out += '-';
+                break;
+            case SeStringMacro::NonBreakingSpace:
+                // U+00A0 in UTF-8
+                out += "\xC2\xA0";
+                break;
+            case SeStringMacro::SoftHyphen:
+                // U+00AD in UTF-8
+                out += "\xC2\xAD";
+                break;
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <random>
+
+#include "meshprocessing.h"
+
+using Triangle = std::array<std::array<float, 3>, 3>;
+
+/*
+ * Builds a grid where every quad has its own four vertices and the triangles are shuffled, which is about the worst
+ * case for both the vertex count and the post-transform cache.
+ */
+static Part buildShuffledGrid(const int size) {
+    Part part;
+
+    std::vector<std::array<uint16_t, 3>> triangles;
+    for(int y = 0; y < size; y++) {
+        for(int x = 0; x < size; x++) {
+            const auto first = static_cast<uint16_t>(part.vertices.size());
+
+            for(int corner = 0; corner < 4; corner++) {
+                Vertex vertex = {};
+                vertex.position = {static_cast<float>(x + (corner & 1)), static_cast<float>(y + (corner >> 1)), 0.0f};
+                vertex.uv = {vertex.position[0] / size, vertex.position[1] / size};
+                vertex.normal = {0.0f, 0.0f, 1.0f};
+                vertex.boneWeights = {1.0f, 0.0f, 0.0f, 0.0f};
+
+                part.vertices.push_back(vertex);
+            }
+
+            triangles.push_back({first, static_cast<uint16_t>(first + 1), static_cast<uint16_t>(first + 2)});
+            triangles.push_back({static_cast<uint16_t>(first + 1), static_cast<uint16_t>(first + 3), static_cast<uint16_t>(first + 2)});
+        }
+    }
+
+    std::mt19937 random(1);
+    std::shuffle(triangles.begin(), triangles.end(), random);
+
+    for(const auto& triangle : triangles)
+        part.indices.insert(part.indices.end(), triangle.begin(), triangle.end());
+
+    part.submeshes.push_back({0, static_cast<uint32_t>(part.indices.size()), 0, 0});
+
+    return part;
+}
+
+/*
+ * Returns every triangle by the positions of its corners, sorted so two parts can be compared no matter how their
+ * vertices and triangles are ordered. Corners are rotated to start at the smallest one, which keeps the winding.
+ */
+static std::vector<Triangle> getTriangles(const Part& part) {
+    std::vector<Triangle> triangles;
+
+    for(size_t i = 0; i + 2 < part.indices.size(); i += 3) {
+        Triangle triangle;
+        for(size_t corner = 0; corner < 3; corner++)
+            triangle[corner] = part.vertices[part.indices[i + corner]].position;
+
+        std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+        triangles.push_back(triangle);
+    }
+
+    std::sort(triangles.begin(), triangles.end());
+
+    return triangles;
+}
+
+int main() {
+    // 4 * 60 * 60 = 14,400 vertices before welding
+    Part part = buildShuffledGrid(60);
+
+    const std::vector<Triangle> trianglesBefore = getTriangles(part);
+
+    const MeshProcessingStats stats = processPart(part);
+
+    bool failed = false;
+
+    // the grid has 61 * 61 unique corners
+    if(stats.vertexCountAfter != 61 * 61) {
+        printf("expected %d vertices, got %zu\n", 61 * 61, stats.vertexCountAfter);
+        failed = true;
+    }
+
+    if(stats.acmrAfter >= stats.acmrBefore) {
+        printf("ACMR didn't improve: %.3f -> %.3f\n", stats.acmrBefore, stats.acmrAfter);
+        failed = true;
+    }
+
+    if(getTriangles(part) != trianglesBefore) {
+        printf("the triangles changed\n");
+        failed = true;
+    }
+
+    if(part.submeshes.size() != 1 || part.submeshes[0].indexOffset != 0 ||
+       part.submeshes[0].indexCount != part.indices.size()) {
+        printf("the submesh doesn't cover every index anymore\n");
+        failed = true;
+    }
+
+    return failed ? 1 : 0;
+}